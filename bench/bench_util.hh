@@ -0,0 +1,55 @@
+#ifndef __FISKA_ASSEMBLER_BENCH_BENCH_UTIL_HH__
+#define __FISKA_ASSEMBLER_BENCH_BENCH_UTIL_HH__
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+#include "base.hh"
+
+// Shared by the benchmarks. Each benchmark is a single translation unit, which
+// is the only one that may include this header since it replaces the global
+// |operator new|.
+
+// ============================================================================
+// Allocation counting
+//
+// Every allocation of the process goes through these, which lets a benchmark
+// report how many allocations each unit of work costs.
+// ============================================================================
+namespace fiskas {
+namespace bench {
+inline std::atomic<usz> num_allocations = 0;
+} // namespace bench
+} // namespace fiskas
+
+auto operator new(usz size) -> void * {
+	fiskas::bench::num_allocations.fetch_add(1, std::memory_order_relaxed);
+	if (void *ptr = std::malloc(size == 0 ? 1 : size)) return ptr;
+	throw std::bad_alloc();
+}
+
+auto operator delete(void *ptr) noexcept -> void { std::free(ptr); }
+auto operator delete(void *ptr, usz) noexcept -> void { std::free(ptr); }
+
+namespace fiskas {
+namespace bench {
+
+// Small deterministic generator so that every run, on every machine, works on
+// the exact same input.
+struct Rng {
+	u64 state;
+
+public:
+	auto next() -> u64 {
+		state = state * 6364136223846793005 + 1442695040888963407;
+		return state >> 17;
+	}
+	auto below(usz bound) -> usz { return usz(next() % bound); }
+	auto chance(f64 probability) -> bool { return f64(next() % 1'000'000) < probability * 1e6; }
+};
+
+} // namespace bench
+} // namespace fiskas
+
+#endif // __FISKA_ASSEMBLER_BENCH_BENCH_UTIL_HH__
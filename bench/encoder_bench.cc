@@ -0,0 +1,215 @@
+#include <string>
+#include <vector>
+
+#include "arena.hh"
+#include "base.hh"
+#include "bench_util.hh"
+#include "block_encoder.hh"
+#include "instruction_stream.hh"
+#include "x86_instructions/mov/mov.hh"
+#include "x86_instructions/static_encoder.hh"
+
+using namespace fiskas;
+using namespace fiskas::bench;
+
+namespace {
+
+using common::RegName;
+
+// A mix of the forms a compiler emits: mostly register moves, loads and stores,
+// some immediates and a few returns.
+auto generate_stream(Arena &arena, usz num_instructions, u64 seed) -> parser::InstructionStream {
+	constexpr RegName registers[] = {
+		RegName::Rax, RegName::Rbx, RegName::Rcx, RegName::Rdx, RegName::Rsi, RegName::Rdi,
+		RegName::Rbp, RegName::Rsp, RegName::R8, RegName::R9, RegName::R12, RegName::R13, RegName::R15,
+	};
+	constexpr u64 immediates[] = {0, 42, 0xffffffff, u64(-1), 0x1234'5678'9abc};
+	constexpr i32 displacements[] = {0, 8, -16, 0x1000};
+
+	Rng rng{seed};
+	auto reg = [&] { return registers[rng.below(std::size(registers))]; };
+	auto mem = [&] {
+		common::MemRef mem{
+			.base = reg(),
+			.index = std::nullopt,
+			.scale = common::MemRef::Scale::One,
+			.disp = displacements[rng.below(std::size(displacements))],
+		};
+		if (rng.below(3) == 0) {
+			RegName index = reg();
+			if (index != RegName::Rsp) mem.index = index;
+			mem.scale = common::MemRef::Scale(1 << rng.below(4));
+		}
+		return mem;
+	};
+
+	parser::InstructionStreamBuilder builder;
+	for (usz i = 0; i < num_instructions; ++i) {
+		switch (rng.below(8)) {
+			case 0:
+			case 1:
+			case 2:
+				builder.push(common::X86Mnemonic::Mov, parser::Form::RegReg, 0);
+				builder.push_reg(reg());
+				builder.push_reg(reg());
+				break;
+			case 3:
+				builder.push(common::X86Mnemonic::Mov, parser::Form::RegMem, 0);
+				builder.push_reg(reg());
+				builder.push_mem(mem());
+				break;
+			case 4:
+				builder.push(common::X86Mnemonic::Mov, parser::Form::MemReg, 0);
+				builder.push_mem(mem());
+				builder.push_reg(reg());
+				break;
+			case 5:
+			case 6:
+				builder.push(common::X86Mnemonic::Mov, parser::Form::RegImm, 0);
+				builder.push_reg(reg());
+				builder.push_imm(immediates[rng.below(std::size(immediates))]);
+				break;
+			default:
+				builder.push(common::X86Mnemonic::Ret, parser::Form::NoOperands, 0);
+				break;
+		}
+	}
+	return builder.freeze(arena, 0);
+}
+
+struct Measurement {
+	f64 seconds = 1e30;
+	usz allocations{};
+	usz bytes{};
+};
+
+// Best time out of |runs| runs. The allocations are the ones of a single run.
+template <typename Callable>
+auto best_of(usz runs, Callable &&cb) -> Measurement {
+	Measurement best;
+	for (usz run = 0; run < runs; ++run) {
+		usz allocations_before = num_allocations.load(std::memory_order_relaxed);
+		auto start = chr::steady_clock::now();
+		usz bytes = cb();
+		auto end = chr::steady_clock::now();
+
+		best.seconds = std::min(best.seconds, chr::duration<f64>(end - start).count());
+		best.allocations = num_allocations.load(std::memory_order_relaxed) - allocations_before;
+		best.bytes = bytes;
+	}
+	return best;
+}
+
+auto report(std::string_view desc, usz num_instructions, const Measurement &m) -> void {
+	fmt::print("{:<24} {:8.2f} ns/instr {:8.1f} MB/s {:10} allocs ({:.4f} allocs/instr)\n",
+			desc, m.seconds * 1e9 / f64(num_instructions), f64(m.bytes) / m.seconds / 1e6,
+			m.allocations, f64(m.allocations) / f64(num_instructions));
+}
+
+} // namespace
+
+auto main(i32 argc, char *argv[]) -> i32 {
+	usz num_instructions = argc > 1 ? std::stoul(argv[1]) : 1'000'000;
+	constexpr usz runs = 5;
+
+	Arena arena;
+	parser::InstructionStream stream = generate_stream(arena, num_instructions, 0x5eed);
+
+	// Encoding into a section that was sized up front must not allocate at all.
+	std::vector<u8> section;
+	section.reserve(num_instructions * common::max_instruction_size);
+	report("encode into section", num_instructions, best_of(runs, [&] {
+		section.clear();
+		for (usz idx = 0; idx < stream.size(); ++idx) {
+			common::InstructionBytes bytes = parser::encode_instruction(stream, idx);
+			section.insert(section.end(), bytes.begin(), bytes.end());
+		}
+		return section.size();
+	}));
+
+	// Only the growth of the section allocates here.
+	report("encode into new section", num_instructions, best_of(runs, [&] {
+		std::vector<u8> fresh;
+		for (usz idx = 0; idx < stream.size(); ++idx) {
+			common::InstructionBytes bytes = parser::encode_instruction(stream, idx);
+			fresh.insert(fresh.end(), bytes.begin(), bytes.end());
+		}
+		return fresh.size();
+	}));
+
+	// The whole stream in one call, with the runs of register moves encoded
+	// together.
+	report("encode block", num_instructions, best_of(runs, [&] {
+		section.clear();
+		parser::encode_block(stream, section);
+		return section.size();
+	}));
+
+	// The same through a cache. The stream repeats the same instructions a
+	// lot, so most of them hit once the cache is warm.
+	parser::EncodingCache cache;
+	report("encode block with cache", num_instructions, best_of(runs, [&] {
+		section.clear();
+		parser::encode_block(stream, section, &cache);
+		return section.size();
+	}));
+	fmt::print("{:<24} {:8.1f} % hits over {} lookups\n", "", cache.stats.hit_rate() * 100, cache.stats.lookups());
+
+	// The same register moves through the runtime encoder and through the one
+	// specialized at compile time.
+	std::vector<std::pair<RegName, RegName>> moves(num_instructions);
+	Rng rng{0x5eed};
+	for (auto &[dst, src] : moves) {
+		dst = RegName(+RegName::Rax + rng.below(16));
+		src = RegName(+RegName::Rax + rng.below(16));
+	}
+
+	report("mov(reg, reg) runtime", num_instructions, best_of(runs, [&] {
+		section.clear();
+		for (auto [dst, src] : moves) {
+			common::InstructionBytes bytes = x86_instruction::MovRegToReg{
+				.dst = {.name = dst, .width = common::BitWidth::b64},
+				.src = {.name = src, .width = common::BitWidth::b64},
+			}.encode();
+			section.insert(section.end(), bytes.begin(), bytes.end());
+		}
+		return section.size();
+	}));
+
+	std::vector<std::pair<x86_instruction::Reg64, x86_instruction::Reg64>> static_moves;
+	for (auto [dst, src] : moves) static_moves.emplace_back(x86_instruction::Reg64::of(dst), x86_instruction::Reg64::of(src));
+
+	report("mov(reg, reg) static", num_instructions, best_of(runs, [&] {
+		section.resize(num_instructions * common::max_instruction_size);
+		u8 *out = section.data();
+		for (auto [dst, src] : static_moves) out = x86_instruction::encode<common::X86Mnemonic::Mov>(out, dst, src);
+		section.resize(usz(out - section.data()));
+		return section.size();
+	}));
+
+	// The same moves as a function body, one instruction at a time and as a block.
+	parser::InstructionStreamBuilder builder;
+	for (auto [dst, src] : moves) {
+		builder.push(common::X86Mnemonic::Mov, parser::Form::RegReg, 0);
+		builder.push_reg(dst);
+		builder.push_reg(src);
+	}
+	parser::InstructionStream move_stream = builder.freeze(arena, 0);
+
+	report("mov(reg, reg) stream", num_instructions, best_of(runs, [&] {
+		section.clear();
+		for (usz idx = 0; idx < move_stream.size(); ++idx) {
+			common::InstructionBytes bytes = parser::encode_instruction(move_stream, idx);
+			section.insert(section.end(), bytes.begin(), bytes.end());
+		}
+		return section.size();
+	}));
+
+	report("mov(reg, reg) block", num_instructions, best_of(runs, [&] {
+		section.clear();
+		parser::encode_block(move_stream, section);
+		return section.size();
+	}));
+
+	return 0;
+}
@@ -0,0 +1,181 @@
+#include <string>
+#include <vector>
+
+#include "base.hh"
+#include "bench_util.hh"
+#include "char_scan.hh"
+#include "lexer.hh"
+#include "splitter.hh"
+#include "structural_index.hh"
+#include "token_buffer.hh"
+
+using namespace fiskas;
+using namespace fiskas::bench;
+
+namespace {
+
+// ============================================================================
+// Synthetic corpus
+// ============================================================================
+struct CorpusConfig {
+	usz num_functions = 4096;
+	usz instructions_per_function = 64;
+	// Comment lines per instruction. Values above 1 are allowed.
+	f64 comment_density = 0.25;
+	// Length of the function names. Registers and mnemonics have fixed lengths.
+	usz ident_len = 24;
+	u64 seed = 0x5eed;
+};
+
+auto generate_corpus(const CorpusConfig &config) -> std::string {
+	constexpr std::string_view registers[] = {
+		"rax", "rbx", "rcx", "rdx", "rsi", "rdi", "rsp", "rbp",
+		"r8", "r9", "r10", "r11", "r12", "r13", "r14", "r15",
+	};
+	constexpr std::string_view comments[] = {
+		"// Save the caller's value before clobbering it.",
+		"// TODO: pick a better register here.",
+		"/* Inputs are passed in rax and rbx, outputs are returned in rax. */",
+		"//",
+	};
+	constexpr std::string_view numbers[] = {"0x7fffffff", "0b1010", "1_000_000", "42", "0xdead_beef"};
+
+	Rng rng{config.seed};
+	auto emit_comments = [&](std::string &out, std::string_view indent) {
+		f64 density = config.comment_density;
+		for (; density >= 1; density -= 1) {
+			out += fmt::format("{}{}\n", indent, comments[rng.below(std::size(comments))]);
+		}
+		if (rng.chance(density)) out += fmt::format("{}{}\n", indent, comments[rng.below(std::size(comments))]);
+	};
+
+	std::string corpus;
+	for (usz fn_idx = 0; fn_idx < config.num_functions; ++fn_idx) {
+		std::string name = fmt::format("f{}_", fn_idx);
+		while (name.size() < config.ident_len) name += char('a' + rng.below(26));
+
+		emit_comments(corpus, "");
+		corpus += fmt::format("fn {}() {{\n", name);
+		for (usz i = 0; i < config.instructions_per_function; ++i) {
+			emit_comments(corpus, "\t");
+			auto dst = registers[rng.below(std::size(registers))];
+			switch (rng.below(4)) {
+				case 0:
+					corpus += fmt::format("\tmov({}, {});\n", dst, numbers[rng.below(std::size(numbers))]);
+					break;
+				case 1:
+					corpus += "\tret();\n";
+					break;
+				default:
+					corpus += fmt::format("\tmov({}, {});\n", dst, registers[rng.below(std::size(registers))]);
+					break;
+			}
+		}
+		corpus += "}\n\n";
+	}
+	return corpus;
+}
+
+auto parse_args(i32 argc, char *argv[]) -> CorpusConfig {
+	CorpusConfig config;
+	for (i32 i = 1; i < argc; ++i) {
+		std::string_view arg = argv[i];
+		fiska_assert(i + 1 < argc, "Missing value for '{}'", arg);
+		std::string value = argv[++i];
+
+		if (arg == "--functions") config.num_functions = std::stoul(value);
+		else if (arg == "--instructions") config.instructions_per_function = std::stoul(value);
+		else if (arg == "--comments") config.comment_density = std::stod(value);
+		else if (arg == "--ident-len") config.ident_len = std::stoul(value);
+		else if (arg == "--seed") config.seed = std::stoull(value);
+		else {
+			fiska_unreachable("Unknown argument '{}'. Usage: lexer_bench [--functions N] "
+					"[--instructions N] [--comments DENSITY] [--ident-len N] [--seed N]", arg);
+		}
+	}
+	return config;
+}
+
+// ============================================================================
+// Measurements
+// ============================================================================
+struct Measurement {
+	f64 seconds{};
+	usz tokens{};
+	usz allocations{};
+};
+
+// Best time out of |runs| runs. The allocations are the ones of a single run.
+template <typename Callable>
+auto best_of(usz runs, Callable &&cb) -> Measurement {
+	Measurement best{.seconds = 1e30};
+	for (usz run = 0; run < runs; ++run) {
+		usz allocations_before = num_allocations.load(std::memory_order_relaxed);
+		auto start = chr::steady_clock::now();
+		usz tokens = cb();
+		auto end = chr::steady_clock::now();
+
+		best.seconds = std::min(best.seconds, chr::duration<f64>(end - start).count());
+		best.tokens = tokens;
+		best.allocations = num_allocations.load(std::memory_order_relaxed) - allocations_before;
+	}
+	return best;
+}
+
+auto report(scan::Isa isa, std::string_view desc, usz bytes, const Measurement &m) -> void {
+	fmt::print("{:>8}: {:<16} {:8.1f} MB/s {:8.1f} Mtok/s {:8.4f} allocs/tok\n",
+			scan::str_of_isa(isa), desc, f64(bytes) / m.seconds / 1e6,
+			f64(m.tokens) / m.seconds / 1e6,
+			m.tokens ? f64(m.allocations) / f64(m.tokens) : 0.0);
+}
+
+auto lex_all(std::string_view source) -> usz {
+	lexer::Lexer lexer{source};
+	usz tok_count = 0;
+	while (lexer.next_token().kind != lexer::TokenKind::Eof) ++tok_count;
+	return tok_count;
+}
+
+} // namespace
+
+auto main(i32 argc, char *argv[]) -> i32 {
+	CorpusConfig config = parse_args(argc, argv);
+	constexpr usz runs = 5;
+
+	std::string corpus = generate_corpus(config);
+	fmt::print("Corpus: {:.1f} MB, {} functions, {} instructions per function, "
+			"{} comment lines per instruction, {} chars per function name\n",
+			f64(corpus.size()) / 1e6, config.num_functions, config.instructions_per_function,
+			config.comment_density, config.ident_len);
+
+	for (auto isa : {scan::Isa::Scalar, scan::Isa::Sse2, scan::Isa::Avx2}) {
+		if (not scan::is_isa_supported(isa)) {
+			fmt::print("{:>8}: not supported by this cpu\n", scan::str_of_isa(isa));
+			continue;
+		}
+		scan::force_isa(isa);
+
+		report(isa, "next_token", corpus.size(), best_of(runs, [&] { return lex_all(corpus); }));
+		report(isa, "token buffer", corpus.size(), best_of(runs, [&] {
+			return lexer::TokenBuffer::lex(corpus).size();
+		}));
+
+		scan::StructuralIndex index;
+		auto index_time = best_of(runs, [&] {
+			index = scan::StructuralIndex::build(corpus);
+			return usz(0);
+		});
+		fmt::print("{:>8}: {:<16} {:8.1f} MB/s\n",
+				scan::str_of_isa(isa), "structural index", f64(corpus.size()) / index_time.seconds / 1e6);
+
+		usz num_spans = 0;
+		auto split_time = best_of(runs, [&] {
+			num_spans = parser::split_top_level_fns(corpus, index).size();
+			return usz(0);
+		});
+		fmt::print("{:>8}: {:<16} {:8.1f} MB/s ({} functions, index already built)\n",
+				scan::str_of_isa(isa), "fn splitter", f64(corpus.size()) / split_time.seconds / 1e6, num_spans);
+	}
+
+	return 0;
+}
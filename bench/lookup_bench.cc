@@ -0,0 +1,53 @@
+#include <string>
+#include <vector>
+
+#include "base.hh"
+#include "x86_common.hh"
+
+using namespace fiskas;
+
+namespace {
+
+template <typename Lookup>
+auto time_lookups(std::string_view desc, const std::vector<std::string_view> &queries, usz rounds,
+		Lookup &&lookup) -> void {
+	usz found = 0;
+	auto start = chr::steady_clock::now();
+	for (usz round = 0; round < rounds; ++round) {
+		for (auto query : queries) {
+			found += lookup(query);
+		}
+	}
+	auto end = chr::steady_clock::now();
+
+	f64 ns = chr::duration<f64, std::nano>(end - start).count();
+	fmt::print("{:>16}: {:6.2f} ns/lookup ({} hits)\n", desc, ns / f64(rounds * queries.size()), found);
+}
+
+} // namespace
+
+auto main(i32 argc, char *argv[]) -> i32 {
+	usz rounds = argc > 1 ? std::stoul(argv[1]) : 200'000;
+
+	StringMap<common::RegName> dynamic_regnames;
+	for (const auto &[key, value] : common::regnames.items()) {
+		dynamic_regnames.emplace(key, value);
+	}
+
+	// Half hits, half misses that look like register names.
+	std::vector<std::string_view> queries;
+	for (const auto &[key, value] : common::regnames.items()) queries.push_back(key);
+	for (std::string_view miss : {"r16", "rzx", "eaxx", "r1", "xmm0", "ymm15", "cr0", "dr7", 
+			"r8w", "rip", "st0", "mm1", "k1", "zmm31", "bnd0", "tr6"}) {
+		queries.push_back(miss);
+	}
+
+	time_lookups("StringMap", queries, rounds, [&](std::string_view query) -> usz {
+		return dynamic_regnames.contains(query);
+	});
+	time_lookups("StaticStringMap", queries, rounds, [&](std::string_view query) -> usz {
+		return common::reg_name_of_str(query).has_value();
+	});
+
+	return 0;
+}
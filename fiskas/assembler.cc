@@ -0,0 +1,110 @@
+#include "assembler.hh"
+#include "base.hh"
+#include "block_encoder.hh"
+#include "parser.hh"
+#include "splitter.hh"
+
+namespace fiskas {
+
+namespace {
+
+// Hands out the caches of |try_assemble| to the spans being assembled. A pool
+// runs as many spans at a time as it has threads, so there is always a free one.
+struct CacheLender {
+	std::mutex mutex;
+	std::vector<parser::EncodingCache *> free;
+
+public:
+	auto borrow() -> parser::EncodingCache * {
+		std::scoped_lock lock(mutex);
+		fiska_assert(not free.empty(), "Every encoding cache is in use");
+		parser::EncodingCache *cache = free.back();
+		free.pop_back();
+		return cache;
+	}
+	auto give_back(parser::EncodingCache *cache) -> void {
+		std::scoped_lock lock(mutex);
+		free.push_back(cache);
+	}
+};
+
+// Assemble every span, each one reporting to its own sink in |diagnostics| if
+// there are sinks, and lay the functions out in source order.
+auto assemble_spans(std::string_view source, const std::vector<lexer::SourceSpan> &spans,
+		ThreadPool *pool, Diagnostics *diagnostics, std::span<parser::EncodingCache> caches = {}) -> Code
+{
+	std::vector<std::vector<AssembledFunction>> funcs(spans.size());
+
+	CacheLender lender;
+	for (parser::EncodingCache &cache : caches) lender.free.push_back(&cache);
+
+	auto assemble_one = [&](usz idx) {
+		parser::EncodingCache *cache = caches.empty() ? nullptr : lender.borrow();
+		funcs[idx] = assemble_span(source, spans[idx], diagnostics ? &diagnostics[idx] : nullptr, cache);
+		if (cache) lender.give_back(cache);
+	};
+	if (pool) {
+		pool->parallel_for(spans.size(), assemble_one);
+	} else {
+		for (usz idx = 0; idx < spans.size(); ++idx) assemble_one(idx);
+	}
+
+	Code code;
+	for (const AssembledFunction &func : funcs | vws::join) {
+		code.symbols.push_back({
+			.offset = code.text.size(),
+			.code_section = SectionType::Text,
+			.name = func.name,
+			.value = func.code.size(),
+		});
+		::detail::extend(code.text, func.code);
+	}
+	return code;
+}
+
+} // namespace
+
+auto assemble_span(std::string_view source, lexer::SourceSpan span, Diagnostics *diagnostics,
+		parser::EncodingCache *cache) -> std::vector<AssembledFunction>
+{
+	// The instructions only live until they are encoded. Each span gets its
+	// own arena so that the threads don't share one.
+	Arena arena;
+
+	// Only look at the span, but keep offsets relative to the start of the source.
+	parser::Parser parser{source.substr(0, span.end()), &arena, span.offset, diagnostics};
+	std::vector<parser::FuncDecl *> func_decls = parser.parse_program();
+	if (diagnostics and diagnostics->has_errors()) return {};
+
+	std::vector<AssembledFunction> funcs;
+	for (const parser::FuncDecl *func_decl : func_decls) {
+		AssembledFunction &func = funcs.emplace_back(std::string(func_decl->name));
+		parser::encode_block(func_decl->body, func.code, cache);
+	}
+	return funcs;
+}
+
+auto assemble(std::string_view source, ThreadPool *pool) -> Code {
+	return assemble_spans(source, parser::split_top_level_fns(source), pool, nullptr);
+}
+
+auto try_assemble(std::string_view source, ThreadPool *pool, std::span<parser::EncodingCache> caches)
+	-> std::expected<Code, std::vector<Diagnostic>>
+{
+	fiska_assert(caches.empty() or caches.size() >= (pool ? pool->num_threads() : 1),
+		"'{}' encoding caches for '{}' threads", caches.size(), pool ? pool->num_threads() : 1);
+
+	auto spans = parser::try_split_top_level_fns(source, scan::StructuralIndex::build(source));
+	// The parser finds the same error with more context, and keeps going after it.
+	if (not spans) spans = std::vector<lexer::SourceSpan>{{.offset = 0, .len = source.size()}};
+
+	std::vector<Diagnostics> span_diagnostics(spans->size());
+	Code code = assemble_spans(source, *spans, pool, span_diagnostics.data(), caches);
+
+	Diagnostics diagnostics;
+	for (Diagnostics &errors : span_diagnostics) diagnostics.absorb(std::move(errors));
+	if (diagnostics.has_errors()) return std::unexpected(std::move(diagnostics.errors));
+	return code;
+}
+
+} // namespace fiskas
@@ -0,0 +1,48 @@
+#ifndef __FISKA_ASSEMBLER_FISKAS_ASSEMBLER_HH__
+#define __FISKA_ASSEMBLER_FISKAS_ASSEMBLER_HH__
+
+#include <expected>
+#include <string>
+#include <vector>
+
+#include "base.hh"
+#include "diagnostics.hh"
+#include "elf/elf_builder.hh"
+#include "encoding_cache.hh"
+#include "lexer.hh"
+#include "thread_pool.hh"
+
+namespace fiskas {
+
+struct AssembledFunction {
+	std::string name;
+	std::vector<u8> code;
+};
+
+// Lex, parse and encode the function declarations in |span|. Errors go to
+// |diagnostics|, in which case nothing is encoded, or end the process if there
+// is no sink.
+//
+// With a |cache|, the instructions it has already seen aren't encoded again.
+auto assemble_span(std::string_view source, lexer::SourceSpan span, Diagnostics *diagnostics = nullptr,
+		parser::EncodingCache *cache = nullptr) -> std::vector<AssembledFunction>;
+
+// Assemble a whole source file. Functions are laid out in the text section in
+// source order, each one with a symbol pointing at it.
+//
+// With a |pool|, the source is cut at the top level function boundaries and the
+// functions are assembled in parallel. The output is the same either way.
+auto assemble(std::string_view source, ThreadPool *pool = nullptr) -> Code;
+
+// Same as above, but a source with errors gives back all of them, in source
+// order, instead of exiting on the first one.
+//
+// |caches| is opt in. It needs one cache per thread of |pool|, or a single one
+// without a pool, and each span is encoded with a cache no other thread is
+// using at the time. The caches are kept warm from one call to the next.
+auto try_assemble(std::string_view source, ThreadPool *pool = nullptr, std::span<parser::EncodingCache> caches = {})
+	-> std::expected<Code, std::vector<Diagnostic>>;
+
+} // namespace fiskas
+
+#endif // __FISKA_ASSEMBLER_FISKAS_ASSEMBLER_HH__
@@ -0,0 +1,391 @@
+#include <gtest/gtest.h>
+
+#include "assembler.hh"
+#include "base.hh"
+#include "block_encoder.hh"
+#include "jit.hh"
+#include "parser.hh"
+
+namespace fiskas {
+namespace test {
+
+auto generate_program(usz num_funcs) -> std::string {
+	constexpr std::string_view regs[] = {"rax", "rbx", "rcx", "rdx", "r8", "r9", "r12", "r15"};
+
+	std::string program;
+	for (usz f = 0; f < num_funcs; ++f) {
+		program += fmt::format("fn func_{}() {{\n", f);
+		for (usz i = 0; i < f % 7; ++i) {
+			program += fmt::format("\tmov({}, {});\n", regs[(f + i) % 8], regs[(f * 3 + i) % 8]);
+		}
+		program += "\tret();\n}\n";
+	}
+	return program;
+}
+
+TEST(Assembler, LaysOutFunctionsInSourceOrder) {
+	std::string program = "fn a() { ret(); }\nfn b() { mov(rax, rbx); ret(); }";
+
+	Code code = assemble(program);
+	ASSERT_EQ(code.symbols.size(), 2u);
+	EXPECT_EQ(code.symbols[0].name, "a");
+	EXPECT_EQ(code.symbols[0].offset, 0u);
+	EXPECT_EQ(code.symbols[0].value, 1u);
+	EXPECT_EQ(code.symbols[1].name, "b");
+	EXPECT_EQ(code.symbols[1].offset, 1u);
+	EXPECT_EQ(code.text.front(), 0xc3);
+	EXPECT_EQ(code.text.back(), 0xc3);
+}
+
+TEST(Assembler, ParallelOutputMatchesSequentialOutput) {
+	std::string program = generate_program(500);
+
+	Code sequential = assemble(program);
+	for (usz num_threads : {1u, 2u, 4u, 8u}) {
+		ThreadPool pool(num_threads);
+		Code parallel = assemble(program, &pool);
+
+		EXPECT_EQ(parallel.text, sequential.text) << num_threads << " threads";
+		ASSERT_EQ(parallel.symbols.size(), sequential.symbols.size());
+		for (usz i = 0; i < parallel.symbols.size(); ++i) {
+			EXPECT_EQ(parallel.symbols[i].name, sequential.symbols[i].name);
+			EXPECT_EQ(parallel.symbols[i].offset, sequential.symbols[i].offset);
+			EXPECT_EQ(parallel.symbols[i].value, sequential.symbols[i].value);
+		}
+	}
+}
+
+TEST(Assembler, BlockEncoderGivesTheSameCode) {
+	// Runs of register moves with the ones that leave the fast path in the
+	// middle of them, and every other form.
+	std::string program = R"(
+	fn f() {
+		mov(rax, rbx); mov(r8, r15); mov(rsp, r12); mov(r13, rbp);
+		mov(eax, r9d); mov(r10w, cx); mov(ah, bl); mov(sil, r8b); mov(ds, rax); mov(rcx, fs);
+		mov(rdi, rsi);
+		mov(rax, [rbx + 8]); mov([r12 + 4*rcx - 16], r9d); mov(rax, 0x1234_5678_9abc);
+		add(rcx, 1); add(rcx, 0x1000); lea(rax, [rsp + 8]);
+		mov(rax, rcx);
+		xor(eax, eax); ret();
+	}
+	)";
+
+	Arena arena;
+	parser::Parser parser{program, &arena};
+	const parser::InstructionStream &stream = parser.parse_func_decl().value()->body;
+
+	std::vector<u8> expected = {0xcc};
+	for (usz idx = 0; idx < stream.size(); ++idx) {
+		common::InstructionBytes bytes = parser::encode_instruction(stream, idx);
+		expected.insert(expected.end(), bytes.begin(), bytes.end());
+	}
+
+	// Appends to what is already there.
+	std::vector<u8> code = {0xcc};
+	parser::encode_block(stream, code);
+	EXPECT_EQ(code, expected);
+	EXPECT_LE(code.size() - 1, parser::max_encoded_size(stream));
+}
+
+TEST(Assembler, JitFunctionsCanBeCalled) {
+	std::string program = R"(
+	fn answer() { mov(rax, 42); ret(); }
+	fn sum() { mov(rax, rdi); add(rax, rsi); ret(); }
+	fn empty() {}
+	)";
+
+	Arena arena;
+	parser::Parser parser{program, &arena};
+	std::vector<parser::FuncDecl *> func_decls = parser.parse_program();
+	ASSERT_EQ(func_decls.size(), 3u);
+
+	JitFunction answer = jit_compile(*func_decls[0]);
+	EXPECT_EQ(answer.as<i64()>()(), 42);
+
+	// Moving keeps the code mapped.
+	JitFunction sum = jit_compile(*func_decls[1]);
+	JitFunction moved = std::move(sum);
+	EXPECT_EQ(moved.as<i64(i64, i64)>()(40, 2), 42);
+	EXPECT_EQ(moved.as<i64(i64, i64)>()(-1, 1), 0);
+	EXPECT_EQ(sum.ptr, nullptr);
+
+	// Same bytes as the assembler.
+	std::vector<u8> expected = assemble("fn sum() { mov(rax, rdi); add(rax, rsi); ret(); }").text;
+	EXPECT_TRUE(std::ranges::equal(moved.code(), expected));
+
+	JitFunction empty = jit_compile(*func_decls[2]);
+	EXPECT_NE(empty.ptr, nullptr);
+	EXPECT_TRUE(empty.code().empty());
+}
+
+TEST(Assembler, EncodingCacheGivesTheSameCode) {
+	// Moves between 64 bit registers are encoded without the cache, the rest
+	// of the instructions repeat a lot.
+	std::string program = generate_program(100);
+	for (usz f = 0; f < 20; ++f) {
+		program += fmt::format("fn g_{}() {{ mov(rax, [rbx + 8]); add(rcx, {}); mov(eax, ecx); mov([rsp], r9); ret(); }}\n", f, f % 3);
+	}
+	lexer::SourceSpan span{.offset = 0, .len = program.size()};
+	auto without_cache = assemble_span(program, span);
+
+	// A single entry is evicted all the time, but it must still be right.
+	for (usz num_entries : {1u, 64u, 4096u}) {
+		parser::EncodingCache cache(num_entries);
+		auto with_cache = assemble_span(program, span, nullptr, &cache);
+
+		ASSERT_EQ(with_cache.size(), without_cache.size());
+		for (usz i = 0; i < with_cache.size(); ++i) {
+			EXPECT_EQ(with_cache[i].code, without_cache[i].code) << with_cache[i].name << ", " << num_entries << " entries";
+		}
+		// The rets and the five instructions of every g.
+		EXPECT_EQ(cache.stats.lookups(), 100u + 20u * 5);
+	}
+
+	// The program only uses a handful of different instructions.
+	parser::EncodingCache cache;
+	assemble_span(program, span, nullptr, &cache);
+	EXPECT_EQ(cache.stats.misses, 7u);
+
+	// Everything hits the second time around.
+	cache.reset_stats();
+	assemble_span(program, span, nullptr, &cache);
+	EXPECT_EQ(cache.stats.misses, 0u);
+	EXPECT_EQ(cache.stats.hit_rate(), 1.0);
+}
+
+TEST(Assembler, EncodingCachePerThread) {
+	std::string program = generate_program(500) + "fn g() { mov(eax, ebx); mov(eax, ebx); add(rax, 1); }\n";
+	auto without_cache = try_assemble(program);
+	ASSERT_TRUE(without_cache.has_value());
+
+	for (usz num_threads : {1u, 4u}) {
+		ThreadPool pool(num_threads);
+		std::vector<parser::EncodingCache> caches(num_threads);
+		for (usz run = 0; run < 2; ++run) {
+			auto with_cache = try_assemble(program, &pool, caches);
+			ASSERT_TRUE(with_cache.has_value());
+			EXPECT_EQ(with_cache->text, without_cache->text) << num_threads << " threads, run " << run;
+		}
+
+		usz hits = 0;
+		usz lookups = 0;
+		for (const parser::EncodingCache &cache : caches) {
+			hits += cache.stats.hits;
+			lookups += cache.stats.lookups();
+		}
+		EXPECT_EQ(lookups, 2u * (500 + 3));
+		EXPECT_GT(hits, lookups / 2);
+	}
+}
+
+TEST(Assembler, MemoryOperandsTakeTheShortestEncoding) {
+	// Expected bytes are the ones of GNU as.
+	std::pair<std::string_view, std::vector<u8>> cases[] = {
+		{"mov(rax, [rbx]);", {0x48, 0x8b, 0x03}},
+		{"mov(rax, [rbx + 8]);", {0x48, 0x8b, 0x43, 0x08}},
+		{"mov(rax, [rbx + 0x100]);", {0x48, 0x8b, 0x83, 0x00, 0x01, 0x00, 0x00}},
+		{"mov(rax, [rbx - 128]);", {0x48, 0x8b, 0x43, 0x80}},
+		{"mov(rax, [rbx - 129]);", {0x48, 0x8b, 0x83, 0x7f, 0xff, 0xff, 0xff}},
+		{"mov(rax, [rsp]);", {0x48, 0x8b, 0x04, 0x24}},
+		{"mov(rax, [rbp]);", {0x48, 0x8b, 0x45, 0x00}},
+		{"mov(rax, [r12]);", {0x49, 0x8b, 0x04, 0x24}},
+		{"mov(rax, [r13]);", {0x49, 0x8b, 0x45, 0x00}},
+		{"mov(rax, [rax + 8*rbx]);", {0x48, 0x8b, 0x04, 0xd8}},
+		{"mov(rax, [rbx*4 + 16]);", {0x48, 0x8b, 0x04, 0x9d, 0x10, 0x00, 0x00, 0x00}},
+		{"mov(rax, [0x1000]);", {0x48, 0x8b, 0x04, 0x25, 0x00, 0x10, 0x00, 0x00}},
+		{"mov([r9 + r10*2 - 8], r11);", {0x4f, 0x89, 0x5c, 0x51, 0xf8}},
+		{"mov(rcx, [rbx + rsp]);", {0x48, 0x8b, 0x0c, 0x1c}},
+		{"mov(rcx, [1*rbx]);", {0x48, 0x8b, 0x0b}},
+	};
+
+	for (const auto &[instruction, bytes] : cases) {
+		Code code = assemble(fmt::format("fn f() {{ {} }}", instruction));
+		EXPECT_EQ(code.text, bytes) << instruction;
+	}
+}
+
+TEST(Assembler, ImmediatesTakeTheShortestEncoding) {
+	// Expected bytes are the ones of GNU as.
+	std::pair<std::string_view, std::vector<u8>> cases[] = {
+		{"mov(rax, 0x18b);", {0xb8, 0x8b, 0x01, 0x00, 0x00}},
+		{"mov(r9, 1);", {0x41, 0xb9, 0x01, 0x00, 0x00, 0x00}},
+		{"mov(r12, 0xffffffff);", {0x41, 0xbc, 0xff, 0xff, 0xff, 0xff}},
+		{"mov(rax, -1);", {0x48, 0xc7, 0xc0, 0xff, 0xff, 0xff, 0xff}},
+		{"mov(rcx, -2147483648);", {0x48, 0xc7, 0xc1, 0x00, 0x00, 0x00, 0x80}},
+		{"mov(rdx, 0x1_2345_6789);", {0x48, 0xba, 0x89, 0x67, 0x45, 0x23, 0x01, 0x00, 0x00, 0x00}},
+		{"mov(r15, 0x8000000000000000);", {0x49, 0xbf, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x80}},
+		{"mov(rsi, -2147483649);", {0x48, 0xbe, 0xff, 0xff, 0xff, 0x7f, 0xff, 0xff, 0xff, 0xff}},
+	};
+
+	for (const auto &[instruction, bytes] : cases) {
+		Code code = assemble(fmt::format("fn f() {{ {} }}", instruction));
+		EXPECT_EQ(code.text, bytes) << instruction;
+	}
+
+	auto code = try_assemble("fn f() { mov(rax, -0x8000000000000001); }");
+	ASSERT_FALSE(code.has_value());
+	EXPECT_EQ(code.error().front().message, "Immediate '-9223372036854775809' does not fit in 64 bits");
+
+	// Narrower destinations take their unsigned and their signed range.
+	std::pair<std::string_view, std::vector<u8>> narrow[] = {
+		{"mov(al, 255);", {0xb0, 0xff}},
+		{"mov(al, -128);", {0xb0, 0x80}},
+		{"mov(ax, 0xffff);", {0x66, 0xb8, 0xff, 0xff}},
+		{"mov(eax, 0xffff_ffff);", {0xb8, 0xff, 0xff, 0xff, 0xff}},
+		{"mov(eax, -0x8000_0000);", {0xb8, 0x00, 0x00, 0x00, 0x80}},
+	};
+	for (const auto &[instruction, bytes] : narrow) {
+		Code code = assemble(fmt::format("fn f() {{ {} }}", instruction));
+		EXPECT_EQ(code.text, bytes) << instruction;
+	}
+
+	std::pair<std::string_view, std::string_view> too_wide[] = {
+		{"mov(al, 256);", "Immediate '256' does not fit in 8 bits"},
+		{"mov(al, -129);", "Immediate '-129' does not fit in 8 bits"},
+		{"mov(ax, 0x10000);", "Immediate '65536' does not fit in 16 bits"},
+		{"mov(eax, 0x1_0000_0000);", "Immediate '4294967296' does not fit in 32 bits"},
+	};
+	for (const auto &[instruction, message] : too_wide) {
+		auto code = try_assemble(fmt::format("fn f() {{ {} }}", instruction));
+		ASSERT_FALSE(code.has_value()) << instruction;
+		EXPECT_EQ(code.error().front().message, message) << instruction;
+	}
+}
+
+TEST(Assembler, NarrowerRegisters) {
+	// Expected bytes are the ones of GNU as.
+	std::pair<std::string_view, std::vector<u8>> cases[] = {
+		{"mov(ecx, eax);", {0x89, 0xc1}},
+		{"mov(ax, bx);", {0x66, 0x89, 0xd8}},
+		{"mov(r9w, 0x1234);", {0x66, 0x41, 0xb9, 0x34, 0x12}},
+		{"mov(al, sil);", {0x40, 0x88, 0xf0}},
+		{"mov(ah, bl);", {0x88, 0xdc}},
+		{"mov(ax, ds);", {0x66, 0x8c, 0xd8}},
+		{"mov(ds, ax);", {0x8e, 0xd8}},
+		{"mov(r8d, [rbx]);", {0x44, 0x8b, 0x03}},
+		{"mov([rax], cx);", {0x66, 0x89, 0x08}},
+		{"mov([rbx], sil);", {0x40, 0x88, 0x33}},
+		{"mov(r9b, [rax + 4]);", {0x44, 0x8a, 0x48, 0x04}},
+		{"mov([rax], fs);", {0x8c, 0x20}},
+		{"mov(es, [rbx]);", {0x8e, 0x03}},
+	};
+
+	for (const auto &[instruction, bytes] : cases) {
+		Code code = assemble(fmt::format("fn f() {{ {} }}", instruction));
+		EXPECT_EQ(code.text, bytes) << instruction;
+	}
+
+	std::pair<std::string_view, std::string_view> invalid[] = {
+		{"mov(ah, sil);", "Registers AH, BH, CH, DH can't be addressed when a REX prefix is present"},
+		{"mov(ds, cs);", "Can't move a segment register to another one"},
+		{"mov(ah, [r8]);", "Registers AH, BH, CH, DH can't be addressed when a REX prefix is present"},
+	};
+	for (const auto &[instruction, message] : invalid) {
+		auto code = try_assemble(fmt::format("fn f() {{ {} }}", instruction));
+		ASSERT_FALSE(code.has_value()) << instruction;
+		EXPECT_EQ(code.error().front().message, message) << instruction;
+	}
+}
+
+TEST(Assembler, TableDrivenInstructions) {
+	// Expected bytes are the ones of GNU as.
+	std::pair<std::string_view, std::vector<u8>> cases[] = {
+		{"add(rax, rbx);", {0x48, 0x01, 0xd8}},
+		{"add(eax, 1);", {0x83, 0xc0, 0x01}},
+		{"add(rax, 0x1000);", {0x48, 0x05, 0x00, 0x10, 0x00, 0x00}},
+		{"add(r9, 0x1000);", {0x49, 0x81, 0xc1, 0x00, 0x10, 0x00, 0x00}},
+		{"add(r9, -128);", {0x49, 0x83, 0xc1, 0x80}},
+		{"add(r9b, 200);", {0x41, 0x80, 0xc1, 0xc8}},
+		{"add(al, 5);", {0x04, 0x05}},
+		{"sub(ax, 300);", {0x66, 0x2d, 0x2c, 0x01}},
+		{"sub(cx, -2);", {0x66, 0x83, 0xe9, 0xfe}},
+		{"xor(ecx, ecx);", {0x31, 0xc9}},
+		{"and(r12d, 0xffff);", {0x41, 0x81, 0xe4, 0xff, 0xff, 0x00, 0x00}},
+		{"or([rbx + 8], sil);", {0x40, 0x08, 0x73, 0x08}},
+		{"cmp([rsp], rdx);", {0x48, 0x39, 0x14, 0x24}},
+		{"cmp(rdx, [rsp]);", {0x48, 0x3b, 0x14, 0x24}},
+		{"cmp(rax, -1);", {0x48, 0x83, 0xf8, 0xff}},
+		{"lea(rax, [rbx + rcx*4 + 8]);", {0x48, 0x8d, 0x44, 0x8b, 0x08}},
+		{"lea(r13w, [r14]);", {0x66, 0x45, 0x8d, 0x2e}},
+		{"ret();", {0xc3}},
+	};
+
+	for (const auto &[instruction, bytes] : cases) {
+		Code code = assemble(fmt::format("fn f() {{ {} }}", instruction));
+		EXPECT_EQ(code.text, bytes) << instruction;
+	}
+
+	std::pair<std::string_view, std::string_view> invalid[] = {
+		{"lea(rax, rbx);", "Unsupported operands for lea. Expected lea(reg, mem)"},
+		{"lea(al, [rbx]);", "lea doesn't take 8 bit operands"},
+		{"add(rax, ecx);", "Register size mismatch in add instruction. src register width = '32' and dst register width = '64' bits"},
+		{"add(rax, 0x80000000);", "Immediate '2147483648' does not fit in a sign extended 32 bit immediate"},
+		{"add(al, 300);", "Immediate '300' does not fit in 8 bits"},
+		{"sub(ax, 70000);", "Immediate '70000' does not fit in 16 bits"},
+		{"cmp(eax, 0x1_0000_0000);", "Immediate '4294967296' does not fit in 32 bits"},
+		{"sub(ds, ax);", "Segment register 'DS' can't be an operand of sub"},
+		{"xor(ah, sil);", "Registers AH, BH, CH, DH can't be addressed when a REX prefix is present"},
+	};
+	for (const auto &[instruction, message] : invalid) {
+		auto code = try_assemble(fmt::format("fn f() {{ {} }}", instruction));
+		ASSERT_FALSE(code.has_value()) << instruction;
+		EXPECT_EQ(code.error().front().message, message) << instruction;
+	}
+}
+
+TEST(Assembler, InvalidMemoryOperands) {
+	std::pair<std::string_view, std::string_view> cases[] = {
+		{"mov(rax, [rbx + rcx + rdx]);", "An address has at most a base and an index register"},
+		{"mov(rax, [rbx*2 + rcx*2]);", "An address has at most a base and an index register"},
+		{"mov(rax, [rbx*3]);", "Scale '3' is not one of 1, 2, 4 or 8"},
+		{"mov(rax, [rbx - rcx]);", "Registers can't be subtracted in an address"},
+		{"mov(rax, [rbx + rsp*2]);", "RSP can't be used as an index register"},
+		{"mov(rax, [rbx + 0x80000000]);", "Displacement '2147483648' does not fit in 32 bits"},
+		{"mov(rax, [rbx + 4);", "Expected token '<RightBracket>' but found '<RightParen>'"},
+		{"mov([rax], [rbx]);", "Unsupported operands for mov. Expected mov(reg, reg), mov(reg, mem), mov(mem, reg) or mov(reg, imm)"},
+	};
+
+	for (const auto &[instruction, message] : cases) {
+		auto code = try_assemble(fmt::format("fn f() {{ {} }}", instruction));
+		ASSERT_FALSE(code.has_value()) << instruction;
+		EXPECT_EQ(code.error().front().message, message) << instruction;
+	}
+}
+
+TEST(Assembler, TryAssembleCollectsEveryError) {
+	std::string program = generate_program(50);
+	ASSERT_TRUE(try_assemble(program).has_value());
+
+	program += "fn bad_1() {\n\tmov(rax, rsx);\n}\n";
+	program += "fn bad_2() {\n\tret(rax);\n\tmov(rax, 0b102);\n}\n";
+
+	ThreadPool pool(4);
+	for (ThreadPool *p : {static_cast<ThreadPool *>(nullptr), &pool}) {
+		auto code = try_assemble(program, p);
+		ASSERT_FALSE(code.has_value());
+		ASSERT_EQ(code.error().size(), 3u);
+		EXPECT_EQ(code.error()[0].message, "Unrecognized register name 'rsx'");
+		EXPECT_EQ(code.error()[1].message, "ret takes no operands, found '1'");
+		EXPECT_EQ(code.error()[2].message, "Invalid digit in number literal '0b102'");
+		EXPECT_LT(code.error()[0].offset, code.error()[1].offset);
+	}
+}
+
+TEST(Assembler, TryAssembleWithUnbalancedBraces) {
+	auto code = try_assemble("fn a() {\n\tret();\n");
+	ASSERT_FALSE(code.has_value());
+	ASSERT_EQ(code.error().size(), 1u);
+	EXPECT_EQ(code.error()[0].message, "Unclosed '{' of function 'a'");
+}
+
+TEST(ThreadPool, RunsEveryJobOnce) {
+	ThreadPool pool(4);
+	for (usz round = 0; round < 50; ++round) {
+		std::vector<std::atomic<u32>> runs(round * 10);
+		pool.parallel_for(runs.size(), [&](usz i) { runs[i]++; });
+		for (auto &count : runs) EXPECT_EQ(count.load(), 1u);
+	}
+}
+
+} // namespace test
+} // namespace fiskas
@@ -0,0 +1,88 @@
+#include "base.hh"
+#include "block_encoder.hh"
+
+namespace fiskas {
+namespace parser {
+
+namespace {
+
+// Copies the whole inline buffer, which saves a variable length copy. |out|
+// has |common::max_instruction_size| bytes of room past the end of the code.
+auto copy_bytes(u8 *out, const common::InstructionBytes &bytes) -> u8 * {
+	std::memcpy(out, bytes.data(), common::max_instruction_size);
+	return out + bytes.size();
+}
+
+auto encode_one(const InstructionStream &stream, usz idx, usz operand_offset, EncodingCache *cache)
+	-> common::InstructionBytes
+{
+	return cache ? cache->encode(stream, idx, operand_offset) : encode_instruction(stream, idx);
+}
+
+// Encodes a run of mov(reg, reg). The moves between 64 bit registers, which
+// is most of them, are REX.W 89 /r and only need the numbers of the registers,
+// so they are encoded without branches straight from the descriptor table.
+auto encode_mov_reg_reg_run(const InstructionStream &stream, usz first, usz last, usz operand_offset,
+		EncodingCache *cache, u8 *out) -> u8 *
+{
+	// The operands of a run are next to each other in the pool, two bytes
+	// per instruction.
+	for (usz idx = first; idx < last; ++idx, operand_offset += 2) {
+		const u8 *regs = stream.operands.data() + operand_offset;
+		common::RegDescriptor dst = common::reg_descriptors[regs[0]];
+		common::RegDescriptor src = common::reg_descriptors[regs[1]];
+		if (dst.width() != common::BitWidth::b64 or src.width() != common::BitWidth::b64) [[unlikely]] {
+			out = copy_bytes(out, encode_one(stream, idx, operand_offset, cache));
+			continue;
+		}
+
+		// [MR] with the source in ModRm:reg. One little endian store writes
+		// the three bytes and one byte of the room past the end.
+		u32 code = u32(0x48 | src.extended() << 2 | dst.extended())
+			| u32(0x89) << 8
+			| u32(0xc0 | src.index() << 3 | dst.index()) << 16;
+		std::memcpy(out, &code, sizeof(code));
+		out += 3;
+	}
+	return out;
+}
+
+} // namespace
+
+auto max_encoded_size(const InstructionStream &stream) -> usz {
+	usz size = 0;
+	for (u8 form : stream.forms) size += max_encoded_size_of_form[form];
+	return size;
+}
+
+auto encode_block(const InstructionStream &stream, std::vector<u8> &out, EncodingCache *cache) -> void {
+	usz start = out.size();
+	out.resize(start + max_encoded_size(stream) + common::max_instruction_size);
+	u8 *curr = out.data() + start;
+
+	usz operand_offset = 0;
+	for (usz first = 0; first < stream.size();) {
+		u8 mnemonic = stream.mnemonics[first];
+		u8 form = stream.forms[first];
+		usz last = first + 1;
+		while (last < stream.size() and stream.mnemonics[last] == mnemonic and stream.forms[last] == form) last++;
+
+		if (common::X86Mnemonic(mnemonic) == common::X86Mnemonic::Mov and Form(form) == Form::RegReg) {
+			curr = encode_mov_reg_reg_run(stream, first, last, operand_offset, cache, curr);
+		} else {
+			for (usz idx = first; idx < last; ++idx) {
+				usz offset = operand_offset + (idx - first) * operand_size_of_form[form];
+				common::InstructionBytes bytes = encode_one(stream, idx, offset, cache);
+				fiska_assert(bytes.size() <= max_encoded_size_of_form[form],
+					"'{}' bytes for an instruction of form '{}'", bytes.size(), str_of_form(Form(form)));
+				curr = copy_bytes(curr, bytes);
+			}
+		}
+		operand_offset += (last - first) * operand_size_of_form[form];
+		first = last;
+	}
+	out.resize(usz(curr - out.data()));
+}
+
+} // namespace parser
+} // namespace fiskas
@@ -0,0 +1,44 @@
+#ifndef __FISKA_ASSEMBLER_FISKAS_BLOCK_ENCODER_HH__
+#define __FISKA_ASSEMBLER_FISKAS_BLOCK_ENCODER_HH__
+
+#include <array>
+#include <vector>
+
+#include "base.hh"
+#include "encoding_cache.hh"
+#include "instruction_stream.hh"
+
+namespace fiskas {
+namespace parser {
+
+// Longest machine code of an instruction of each form, e.g 4 bytes for
+// mov(r8w, r9w) and 10 bytes for a move of a 64 bit immediate.
+constexpr std::array<u8, num_forms> max_encoded_size_of_form = [] {
+	std::array<u8, num_forms> sizes{};
+	// The opcode.
+	sizes[usz(Form::NoOperands)] = 1;
+	// 0x66, REX, the opcode and ModRM.
+	sizes[usz(Form::RegReg)] = 4;
+	// 0x66, REX, the opcode, ModRM, SIB and a 32 bit displacement.
+	sizes[usz(Form::RegMem)] = 9;
+	sizes[usz(Form::MemReg)] = 9;
+	// REX, B8+r and a 64 bit immediate.
+	sizes[usz(Form::RegImm)] = 10;
+	return sizes;
+}();
+
+// Upper bound of the size of the machine code of |stream|.
+auto max_encoded_size(const InstructionStream &stream) -> usz;
+
+// Append the machine code of every instruction of |stream| to |out|. Gives the
+// same bytes as |encode_instruction| on each instruction, but sizes |out| once
+// and encodes runs of instructions of the same mnemonic and form together.
+//
+// With a |cache|, the instructions that aren't moves between 64 bit registers
+// are looked up in it before being encoded.
+auto encode_block(const InstructionStream &stream, std::vector<u8> &out, EncodingCache *cache = nullptr) -> void;
+
+} // namespace parser
+} // namespace fiskas
+
+#endif // __FISKA_ASSEMBLER_FISKAS_BLOCK_ENCODER_HH__
@@ -0,0 +1,171 @@
+#include <atomic>
+
+#include "base.hh"
+#include "char_scan.hh"
+#include "lexer.hh"
+#include "simd.hh"
+
+namespace fiskas {
+namespace scan {
+
+namespace {
+
+using lexer::Cursor;
+using ScanFn = auto (*)(const char *, const char *) -> const char *;
+
+struct Scanners {
+	ScanFn whitespace;
+	ScanFn ident_continue;
+	ScanFn number;
+};
+
+template <bool (*in_class)(char)>
+auto scalar_skip(const char *begin, const char *end) -> const char * {
+	while (begin < end and in_class(*begin)) ++begin;
+	return begin;
+}
+
+#if FISKA_SIMD_X86
+using simd::Sse2;
+using simd::Avx2;
+
+// Consume whole vectors while every byte is in the class, then let the scalar
+// loop finish the tail that is shorter than a vector.
+#define FISKA_DEFINE_VECTOR_SKIP(name, V, cls, scalar_pred, target)                    \
+	target auto name(const char *begin, const char *end) -> const char * {               \
+		while (usz(end - begin) >= V::width) {                                           \
+			u32 in_class = V::mask(V::cls(V::load(begin)));                              \
+			if (in_class != V::all_set) return begin + __builtin_ctz(~in_class);         \
+			begin += V::width;                                                           \
+		}                                                                                \
+		return scalar_skip<scalar_pred>(begin, end);                                     \
+	}
+
+FISKA_DEFINE_VECTOR_SKIP(sse2_skip_whitespace, Sse2, whitespace, Cursor::is_whitespace, )
+FISKA_DEFINE_VECTOR_SKIP(sse2_skip_ident_continue, Sse2, ident_continue, Cursor::is_ident_continue, )
+FISKA_DEFINE_VECTOR_SKIP(sse2_skip_number, Sse2, number, Cursor::is_number, )
+
+FISKA_DEFINE_VECTOR_SKIP(avx2_skip_whitespace, Avx2, whitespace, Cursor::is_whitespace,
+		[[gnu::target("avx2")]])
+FISKA_DEFINE_VECTOR_SKIP(avx2_skip_ident_continue, Avx2, ident_continue, Cursor::is_ident_continue,
+		[[gnu::target("avx2")]])
+FISKA_DEFINE_VECTOR_SKIP(avx2_skip_number, Avx2, number, Cursor::is_number,
+		[[gnu::target("avx2")]])
+
+#undef FISKA_DEFINE_VECTOR_SKIP
+#endif // FISKA_SIMD_X86
+
+constexpr Scanners scalar_scanners = {
+	.whitespace = scalar_skip<Cursor::is_whitespace>,
+	.ident_continue = scalar_skip<Cursor::is_ident_continue>,
+	.number = scalar_skip<Cursor::is_number>,
+};
+
+#if FISKA_SIMD_X86
+constexpr Scanners sse2_scanners = {
+	.whitespace = sse2_skip_whitespace,
+	.ident_continue = sse2_skip_ident_continue,
+	.number = sse2_skip_number,
+};
+
+constexpr Scanners avx2_scanners = {
+	.whitespace = avx2_skip_whitespace,
+	.ident_continue = avx2_skip_ident_continue,
+	.number = avx2_skip_number,
+};
+#endif // FISKA_SIMD_X86
+
+auto scanners_of_isa(Isa isa) -> const Scanners * {
+	switch (isa) {
+		case Isa::Scalar: return &scalar_scanners;
+#if FISKA_SIMD_X86
+		case Isa::Sse2: return &sse2_scanners;
+		case Isa::Avx2: return &avx2_scanners;
+#else
+		case Isa::Sse2:
+		case Isa::Avx2:
+			fiska_unreachable("SIMD scanners are only available on x86");
+#endif
+	}
+	fiska_unreachable();
+}
+
+auto best_supported_isa() -> Isa {
+	if (is_isa_supported(Isa::Avx2)) return Isa::Avx2;
+	if (is_isa_supported(Isa::Sse2)) return Isa::Sse2;
+	return Isa::Scalar;
+}
+
+// Both are constant initialized so that lexing from a static initializer in
+// another translation unit still works. The isa is picked on first use.
+std::atomic<Isa> selected_isa = Isa::Scalar;
+std::atomic<const Scanners *> selected_scanners = nullptr;
+
+auto select_isa(Isa isa) -> const Scanners * {
+	const Scanners *scanners = scanners_of_isa(isa);
+	selected_isa.store(isa, std::memory_order_relaxed);
+	selected_scanners.store(scanners, std::memory_order_relaxed);
+	return scanners;
+}
+
+auto active_scanners() -> const Scanners * {
+	const Scanners *scanners = selected_scanners.load(std::memory_order_relaxed);
+	if (not scanners) [[unlikely]] return select_isa(best_supported_isa());
+	return scanners;
+}
+
+} // namespace
+
+auto str_of_isa(Isa isa) -> std::string {
+	switch (isa) {
+		case Isa::Scalar: return "scalar";
+		case Isa::Sse2: return "sse2";
+		case Isa::Avx2: return "avx2";
+	}
+	fiska_unreachable();
+}
+
+auto is_isa_supported(Isa isa) -> bool {
+#if FISKA_SIMD_X86
+	// We can be called during static initialization, before libgcc had the
+	// chance to fill in the cpu model.
+	__builtin_cpu_init();
+#endif
+	switch (isa) {
+		case Isa::Scalar: return true;
+#if FISKA_SIMD_X86
+		case Isa::Sse2: return __builtin_cpu_supports("sse2");
+		case Isa::Avx2: return __builtin_cpu_supports("avx2");
+#else
+		case Isa::Sse2:
+		case Isa::Avx2:
+			return false;
+#endif
+	}
+	fiska_unreachable();
+}
+
+auto active_isa() -> Isa {
+	active_scanners();
+	return selected_isa.load(std::memory_order_relaxed);
+}
+
+auto force_isa(Isa isa) -> void {
+	fiska_assert(is_isa_supported(isa), "ISA '{}' is not supported by this cpu", str_of_isa(isa));
+	select_isa(isa);
+}
+
+auto skip_whitespace(const char *begin, const char *end) -> const char * {
+	return active_scanners()->whitespace(begin, end);
+}
+
+auto skip_ident_continue(const char *begin, const char *end) -> const char * {
+	return active_scanners()->ident_continue(begin, end);
+}
+
+auto skip_number(const char *begin, const char *end) -> const char * {
+	return active_scanners()->number(begin, end);
+}
+
+} // namespace scan
+} // namespace fiskas
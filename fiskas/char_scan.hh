@@ -0,0 +1,34 @@
+#ifndef __FISKA_ASSEMBLER_FISKAS_CHAR_SCAN_HH__
+#define __FISKA_ASSEMBLER_FISKAS_CHAR_SCAN_HH__
+
+#include "base.hh"
+
+namespace fiskas {
+namespace scan {
+
+// Instruction sets the scanners can be compiled for. The best one supported by
+// the cpu is picked the first time a scanner is called.
+enum struct Isa {
+	Scalar,
+	Sse2,
+	Avx2,
+};
+auto str_of_isa(Isa isa) -> std::string;
+
+auto active_isa() -> Isa;
+auto is_isa_supported(Isa isa) -> bool;
+// Used by the tests and the benchmarks to compare the different implementations.
+auto force_isa(Isa isa) -> void;
+
+// Each scanner returns a pointer to the first char in [begin, end) that does not
+// belong to its character class, or |end| if all of them do.
+//
+// The character classes match the ones in |lexer::Cursor|.
+auto skip_whitespace(const char *begin, const char *end) -> const char *;
+auto skip_ident_continue(const char *begin, const char *end) -> const char *;
+auto skip_number(const char *begin, const char *end) -> const char *;
+
+} // namespace scan
+} // namespace fiskas
+
+#endif // __FISKA_ASSEMBLER_FISKAS_CHAR_SCAN_HH__
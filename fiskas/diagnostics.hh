@@ -0,0 +1,65 @@
+#ifndef __FISKA_ASSEMBLER_FISKAS_DIAGNOSTICS_HH__
+#define __FISKA_ASSEMBLER_FISKAS_DIAGNOSTICS_HH__
+
+#include <expected>
+#include <string>
+#include <vector>
+
+#include "base.hh"
+#include "line_table.hh"
+
+namespace fiskas {
+
+// An error in the source being assembled.
+struct Diagnostic {
+	usz offset{};
+	lexer::SourceLocation location{};
+	std::string message;
+
+public:
+	// "line:col: error: message"
+	auto str() const -> std::string {
+		return fmt::format("{}:{}: error: {}", location.line, location.col, message);
+	}
+};
+
+// Result of a step that can fail on bad input. The error is handed back to
+// the caller, which decides whether to report it and how to recover.
+template <typename T>
+using Expected = std::expected<T, Diagnostic>;
+
+// Evaluate |expr|, an |Expected|, and return its error from the enclosing
+// function if it failed. Otherwise this is the value it holds.
+#define fiska_try(...)                                                                    \
+	({                                                                                    \
+		auto fiska_try_result = (__VA_ARGS__);                                            \
+		if (not fiska_try_result) return std::unexpected(std::move(fiska_try_result.error())); \
+		std::move(fiska_try_result).value();                                              \
+	})
+
+// Collects the errors of a source instead of exiting on the first one, which
+// is what the lexer and the parser do when they aren't given a sink.
+struct Diagnostics {
+	std::vector<Diagnostic> errors;
+
+public:
+	// Only the first error at a given offset is kept. An invalid token the
+	// lexer already complained about doesn't get a second error from the parser.
+	auto report(Diagnostic diagnostic) -> void {
+		if (not errors.empty() and errors.back().offset == diagnostic.offset) return;
+		errors.push_back(std::move(diagnostic));
+	}
+
+	// Append the errors of |other|, which come after ours in the source.
+	auto absorb(Diagnostics &&other) -> void {
+		for (Diagnostic &diagnostic : other.errors) report(std::move(diagnostic));
+		other.errors.clear();
+	}
+
+	auto has_errors() const -> bool { return not errors.empty(); }
+	auto size() const -> usz { return errors.size(); }
+};
+
+} // namespace fiskas
+
+#endif // __FISKA_ASSEMBLER_FISKAS_DIAGNOSTICS_HH__
@@ -0,0 +1,56 @@
+#include <bit>
+
+#include "base.hh"
+#include "encoding_cache.hh"
+
+namespace fiskas {
+namespace parser {
+
+namespace {
+
+// Fold the two words, then Murmur3 finalizer.
+auto hash(const EncodingCache::Key &key) -> u64 {
+	u64 h = key.words[0] ^ (key.words[1] * 0x9e3779b97f4a7c15);
+	h ^= h >> 33;
+	h *= 0xff51afd7ed558ccd;
+	h ^= h >> 33;
+	return h;
+}
+
+} // namespace
+
+EncodingCache::EncodingCache(usz num_entries)
+	: entries(std::bit_ceil(std::max<usz>(num_entries, 1))), mask(entries.size() - 1) {}
+
+auto EncodingCache::encode(const InstructionStream &stream, usz idx, usz operand_offset) -> common::InstructionBytes {
+	std::span<const u8> operands = stream.operands.subspan(operand_offset, operand_size_of_form[stream.forms[idx]]);
+
+	// Built in registers. Going through memory would make the words wait for
+	// the bytes to be stored.
+	Key key;
+	key.words[0] = u64(stream.mnemonics[idx]) | u64(stream.forms[idx]) << 8;
+	for (usz i = 0; i < operands.size(); ++i) {
+		usz byte = 2 + i;
+		key.words[byte / 8] |= u64(operands[i]) << (8 * (byte % 8));
+	}
+
+	// The slots start out with the key of mov(rax, rax) without its operands,
+	// which no instruction has.
+	Entry &entry = entries[hash(key) & mask];
+	if (entry.key == key) {
+		stats.hits++;
+		return entry.bytes;
+	}
+
+	stats.misses++;
+	entry.key = key;
+	entry.bytes = encode_instruction(stream, idx);
+	return entry.bytes;
+}
+
+auto EncodingCache::clear() -> void {
+	std::ranges::fill(entries, Entry{});
+}
+
+} // namespace parser
+} // namespace fiskas
@@ -0,0 +1,74 @@
+#ifndef __FISKA_ASSEMBLER_FISKAS_ENCODING_CACHE_HH__
+#define __FISKA_ASSEMBLER_FISKAS_ENCODING_CACHE_HH__
+
+#include <array>
+#include <vector>
+
+#include "base.hh"
+#include "instruction_stream.hh"
+
+namespace fiskas {
+namespace parser {
+
+// Remembers the machine code of the instructions encoded so far, for code that
+// repeats the same instruction on the same operands a lot. An instruction is
+// looked up by its mnemonic, its form and its packed operands, and a hit skips
+// validating and encoding it.
+//
+// The cache is direct mapped: an instruction only has one slot and replaces
+// whatever was in it. It never allocates after construction, and isn't thread
+// safe, so give each thread its own, see |try_assemble|.
+struct EncodingCache {
+	constexpr static usz default_num_entries = 4096;
+
+	// Mnemonic and form, then the operands, padded with zeroes. The form tells
+	// how many bytes the operands take, so the padding is never ambiguous.
+	// Hashed and compared as two words.
+	struct Key {
+		std::array<u64, 2> words{};
+
+	public:
+		auto operator==(const Key &other) const -> bool {
+			return words[0] == other.words[0] and words[1] == other.words[1];
+		}
+	};
+	static_assert(2 + usz(std::ranges::max(operand_size_of_form)) <= sizeof(Key));
+
+	struct Entry {
+		Key key;
+		common::InstructionBytes bytes;
+	};
+
+	struct Stats {
+		usz hits{};
+		usz misses{};
+
+	public:
+		auto lookups() const -> usz { return hits + misses; }
+		auto hit_rate() const -> f64 { return lookups() ? f64(hits) / f64(lookups()) : 0.0; }
+	};
+
+	std::vector<Entry> entries;
+	usz mask{};
+	Stats stats;
+
+public:
+	// |num_entries| is rounded up to a power of 2.
+	explicit EncodingCache(usz num_entries = default_num_entries);
+
+	// Same as |encode_instruction|. |operand_offset| is where the operands of
+	// |idx| start, which the callers walking the stream already know.
+	auto encode(const InstructionStream &stream, usz idx, usz operand_offset) -> common::InstructionBytes;
+	auto encode(const InstructionStream &stream, usz idx) -> common::InstructionBytes {
+		return encode(stream, idx, stream.operand_offset(idx));
+	}
+
+	auto reset_stats() -> void { stats = {}; }
+	// Forget every instruction. The stats are kept.
+	auto clear() -> void;
+};
+
+} // namespace parser
+} // namespace fiskas
+
+#endif // __FISKA_ASSEMBLER_FISKAS_ENCODING_CACHE_HH__
@@ -0,0 +1,139 @@
+#include <limits>
+
+#include "base.hh"
+#include "incremental.hh"
+
+namespace fiskas {
+namespace lexer {
+
+auto relex(TokenBuffer &buffer, std::string_view new_source, const Edit &edit, Diagnostics *diagnostics)
+	-> RelexResult
+{
+	usz old_size = buffer.offsets.back();
+	fiska_assert(edit.old_end() <= old_size,
+			"Edit [{}, {}) is out of the bounds of the source", edit.offset, edit.old_end());
+	fiska_assert(isz(new_source.size()) == isz(old_size) + edit.delta(),
+			"The edited source is {} bytes long, the edit says it should be {}",
+			new_source.size(), isz(old_size) + edit.delta());
+	fiska_assert(new_source.size() <= std::numeric_limits<u32>::max(),
+			"Source of {} bytes is too big for a token buffer", new_source.size());
+
+	// The tokens ending before the edit don't change, and neither does the
+	// state of the lexer right after them.
+	auto token_indices = vws::iota(usz(0), buffer.size());
+	usz first = *std::ranges::partition_point(token_indices, [&](usz idx) {
+		return buffer.end_of(idx) < edit.offset;
+	});
+	usz restart = first > 0 ? buffer.end_of(first - 1) : 0;
+
+	// Lex until a token starts where one of the old tokens past the edit used to
+	// start. Lexing from a token start only depends on the text that follows, which
+	// is the same from there on, so the rest of the old tokens are still valid.
+	// The Eof tokens always line up.
+	std::vector<Token> new_tokens;
+	Lexer lexer{new_source, restart};
+	lexer.diagnostics = diagnostics;
+	usz resync = first;
+	usz resync_offset = new_source.size();
+	while (true) {
+		Token tok = lexer.next_token();
+
+		if (tok.offset >= edit.new_end()) {
+			usz old_offset = usz(isz(tok.offset) - edit.delta());
+			while (resync < buffer.size() and buffer.offsets[resync] < old_offset) ++resync;
+			if (resync < buffer.size() and buffer.offsets[resync] == old_offset) {
+				resync_offset = tok.offset;
+				break;
+			}
+		}
+		fiska_assert(tok.kind != TokenKind::Eof, "Eof did not line up with the old Eof token");
+		new_tokens.push_back(TokenBuffer::storable(lexer, tok));
+	}
+
+	// Splice the new tokens in and shift everything after them.
+	auto splice = [&]<typename T>(std::vector<T> &column, auto &&project) {
+		auto first_it = column.begin() + isz(first);
+		first_it = column.erase(first_it, column.begin() + isz(resync));
+		column.insert(first_it, new_tokens.size(), T{});
+		for (usz i = 0; i < new_tokens.size(); ++i) column[first + i] = project(new_tokens[i]);
+	};
+	splice(buffer.kinds, [](const Token &tok) { return u8(+tok.kind); });
+	splice(buffer.offsets, [](const Token &tok) { return u32(tok.offset); });
+	splice(buffer.lengths, [](const Token &tok) { return u16(tok.len); });
+	// The values of the numbers that were replaced stay behind in |numbers|.
+	splice(buffer.payloads, [&](const Token &tok) { return buffer.payload_of(tok, lexer.literal(tok)); });
+
+	u32 delta = u32(edit.delta());
+	for (usz i = first + new_tokens.size(); i < buffer.size(); ++i) buffer.offsets[i] += delta;
+
+	return {
+		.first_token = first,
+		.num_old_tokens = resync - first,
+		.num_new_tokens = new_tokens.size(),
+		.relexed = {.offset = restart, .len = resync_offset - restart},
+	};
+}
+
+} // namespace lexer
+
+namespace parser {
+
+auto reparse(
+	Module &module,
+	std::string_view new_source,
+	const Edit &edit,
+	const RelexResult &relex,
+	Diagnostics *diagnostics) -> usz
+{
+	std::vector<FuncDecl *> &func_decls = module.func_decls;
+
+	// Bytes of the edited source to parse again: the relexed ones, and the
+	// region that failed to parse last time if there is one.
+	usz dirty_start = relex.relexed.offset;
+	usz dirty_end = relex.relexed.end();
+	if (module.damaged) {
+		dirty_start = std::min(dirty_start, edit.new_offset_of(module.damaged->offset));
+		dirty_end = std::max(dirty_end, edit.new_offset_of(module.damaged->end()));
+	}
+
+	// Declarations ending before the dirty bytes are untouched and keep their
+	// offsets. Those starting after them, in the old source, only move.
+	usz old_dirty_end = usz(isz(dirty_end) - edit.delta());
+
+	usz first = 0;
+	while (first < func_decls.size() and func_decls[first]->span.end() <= dirty_start) ++first;
+	usz last = first;
+	while (last < func_decls.size() and func_decls[last]->span.offset < old_dirty_end) ++last;
+
+	for (usz i = last; i < func_decls.size(); ++i) {
+		func_decls[i]->span.offset = usz(isz(func_decls[i]->span.offset) + edit.delta());
+	}
+
+	// Parse everything in between the untouched declarations. That covers the
+	// damaged declarations as well as the ones the edit may have added.
+	usz region_start = first > 0 ? func_decls[first - 1]->span.end() : 0;
+	usz region_end = last < func_decls.size() ? func_decls[last]->span.offset : new_source.size();
+
+	// The errors of the region are collected apart to tell whether it parsed.
+	Diagnostics region_errors;
+	Parser parser{new_source.substr(0, region_end), &module.arena, region_start, diagnostics ? &region_errors : nullptr};
+	std::vector<FuncDecl *> reparsed = parser.parse_program();
+
+	if (region_errors.has_errors()) {
+		diagnostics->absorb(std::move(region_errors));
+		// The declarations from before the edit stand in for the region until
+		// it parses again. They span all of it, which keeps the spans of the
+		// module sorted.
+		module.damaged = lexer::SourceSpan{.offset = region_start, .len = region_end - region_start};
+		for (usz i = first; i < last; ++i) func_decls[i]->span = *module.damaged;
+		return 0;
+	}
+	module.damaged.reset();
+
+	auto first_it = func_decls.erase(func_decls.begin() + isz(first), func_decls.begin() + isz(last));
+	func_decls.insert(first_it, reparsed.begin(), reparsed.end());
+	return reparsed.size();
+}
+
+} // namespace parser
+} // namespace fiskas
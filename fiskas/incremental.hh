@@ -0,0 +1,85 @@
+#ifndef __FISKA_ASSEMBLER_FISKAS_INCREMENTAL_HH__
+#define __FISKA_ASSEMBLER_FISKAS_INCREMENTAL_HH__
+
+#include <vector>
+
+#include "base.hh"
+#include "lexer.hh"
+#include "parser.hh"
+#include "token_buffer.hh"
+
+namespace fiskas {
+
+// |removed| bytes at |offset| were replaced with |inserted|.
+struct Edit {
+	usz offset{};
+	usz removed{};
+	std::string_view inserted{};
+
+public:
+	auto delta() const -> isz { return isz(inserted.size()) - isz(removed); }
+	auto old_end() const -> usz { return offset + removed; }
+	auto new_end() const -> usz { return offset + inserted.size(); }
+	// Where |old_offset| of the source before the edit ends up after it. The
+	// removed bytes all map to the end of the inserted ones.
+	auto new_offset_of(usz old_offset) const -> usz {
+		if (old_offset < offset) return old_offset;
+		if (old_offset < old_end()) return new_end();
+		return usz(isz(old_offset) + delta());
+	}
+};
+
+struct RelexResult {
+	// Tokens [first_token, first_token + num_new_tokens) of the buffer were lexed
+	// again and replaced |num_old_tokens| tokens.
+	usz first_token{};
+	usz num_old_tokens{};
+	usz num_new_tokens{};
+	// Bytes of the edited source that were lexed again. Everything before it
+	// lexes exactly like it did before the edit, and so does everything after
+	// it once shifted by |Edit::delta|.
+	lexer::SourceSpan relexed{};
+};
+
+namespace lexer {
+
+// Bring |buffer|, lexed from the source before |edit|, in sync with |new_source|,
+// the source after it. Lexing restarts at the end of the last token the edit
+// can't have touched and stops as soon as a token lines up with a token of the
+// old buffer, past the edit. The tokens after it are only shifted.
+//
+// Errors go to |diagnostics| if there is one, and the tokens in error are kept
+// as |Invalid| tokens so that the buffer still matches |new_source| and the
+// next edit can be applied to it. Otherwise the first error ends the process.
+auto relex(TokenBuffer &buffer, std::string_view new_source, const Edit &edit,
+	Diagnostics *diagnostics = nullptr) -> RelexResult;
+
+} // namespace lexer
+
+namespace parser {
+
+// Update |module|, parsed from the source before |edit|, so it matches
+// |new_source|. Only the declarations overlapping the bytes |relex| had to lex
+// again are parsed again, along with any new declaration the edit introduced.
+// The others only have their span shifted.
+//
+// The new declarations are allocated in the module's arena. The ones they
+// replace stay there until the module is freed.
+//
+// Errors go to |diagnostics| if there is one. The declarations of the region
+// that failed to parse are then left in place and the region is marked as
+// damaged in |module|, see |Module::damaged|, so that the next edit parses it
+// again. Otherwise the first error ends the process.
+//
+// Returns the number of declarations that were parsed, 0 if they had errors.
+auto reparse(
+	Module &module,
+	std::string_view new_source,
+	const Edit &edit,
+	const RelexResult &relex,
+	Diagnostics *diagnostics = nullptr) -> usz;
+
+} // namespace parser
+} // namespace fiskas
+
+#endif // __FISKA_ASSEMBLER_FISKAS_INCREMENTAL_HH__
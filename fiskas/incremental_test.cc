@@ -0,0 +1,223 @@
+#include <gtest/gtest.h>
+
+#include "base.hh"
+#include "incremental.hh"
+
+namespace fiskas {
+namespace test {
+
+using lexer::TokenBuffer;
+using lexer::TokenKind;
+
+auto apply_edit(std::string source, const Edit &edit) -> std::string {
+	return source.replace(edit.offset, edit.removed, edit.inserted);
+}
+
+auto expect_same_tokens(const TokenBuffer &got, const TokenBuffer &expected) -> void {
+	ASSERT_EQ(got.size(), expected.size());
+	for (usz i = 0; i < got.size(); ++i) {
+		EXPECT_EQ(got.kind(i), expected.kind(i)) << "token " << i;
+		EXPECT_EQ(got.offsets[i], expected.offsets[i]) << "token " << i;
+		EXPECT_EQ(got.lengths[i], expected.lengths[i]) << "token " << i;
+		if (got.kind(i) == TokenKind::Identifier) {
+			EXPECT_EQ(got.ident(i), expected.ident(i)) << "token " << i;
+		}
+		if (got.kind(i) == TokenKind::Number) {
+			EXPECT_EQ(got.number(i), expected.number(i)) << "token " << i;
+		}
+	}
+}
+
+auto expect_same_func_decls(const parser::Module &got, const parser::Module &expected) -> void {
+	ASSERT_EQ(got.func_decls.size(), expected.func_decls.size());
+	for (usz i = 0; i < got.func_decls.size(); ++i) {
+		const parser::FuncDecl &g = *got.func_decls[i];
+		const parser::FuncDecl &e = *expected.func_decls[i];
+		EXPECT_EQ(g.name, e.name);
+		EXPECT_EQ(g.span.offset, e.span.offset) << g.name;
+		EXPECT_EQ(g.span.len, e.span.len) << g.name;
+		ASSERT_EQ(g.body.size(), e.body.size()) << g.name;
+		for (usz j = 0; j < g.body.size(); ++j) {
+			EXPECT_EQ(g.body.mnemonic(j), e.body.mnemonic(j));
+			EXPECT_EQ(g.body.source_offset(j), e.body.source_offset(j));
+		}
+	}
+}
+
+struct EditCase {
+	std::string_view desc;
+	Edit edit;
+	// How many tokens the relexing is allowed to produce.
+	usz max_new_tokens;
+	usz expected_reparsed;
+};
+
+const std::string program =
+	"fn first() {\n"
+	"\tmov(rax, rbx);\n"
+	"\tret();\n"
+	"}\n"
+	"\n"
+	"fn second() {\n"
+	"\tmov(r8, r9);\n"
+	"\tmov(r10, r11);\n"
+	"}\n"
+	"\n"
+	"fn third() {\n"
+	"\tret();\n"
+	"}\n";
+
+auto offset_of(std::string_view needle) -> usz {
+	usz offset = program.find(needle);
+	fiska_assert(offset != std::string::npos);
+	return offset;
+}
+
+TEST(Incremental, MatchesAFullRelexAndReparse) {
+	EditCase cases[] = {
+		{"rename a register", {offset_of("r9"), 2, "r12"}, 2, 1},
+		{"extend an identifier", {offset_of("first") + 5, 0, "_fn"}, 3, 1},
+		{"shrink an identifier", {offset_of("second") + 3, 3, ""}, 3, 1},
+		{"add whitespace", {offset_of("(r10") + 1, 0, "   \n "}, 2, 1},
+		{"add an instruction", {offset_of("\tmov(r10"), 0, "\tmov(rcx, rdx);\n"}, 9, 1},
+		{"remove an instruction", {offset_of("\tmov(r10"), 15, ""}, 2, 1},
+		{"add a function in between",
+			{offset_of("fn third"), 0, "fn inserted() { ret(); }\n"}, 10, 1},
+		{"remove a function", {offset_of("fn second"), offset_of("fn third") - offset_of("fn second"), ""},
+			2, 0},
+		{"merge two functions",
+			{offset_of("}\n\nfn third"), offset_of("fn third() {\n") + 13 - offset_of("}\n\nfn third"), ""},
+			3, 1},
+		{"append a function", {program.size(), 0, "fn last() {}"}, 6, 1},
+		{"prepend a function", {0, 0, "fn zeroth() {}\n"}, 7, 1},
+		{"whitespace between functions", {offset_of("\nfn second"), 0, "\n\n\n"}, 1, 0},
+	};
+
+	for (const auto &c : cases) {
+		SCOPED_TRACE(c.desc);
+		std::string new_program = apply_edit(program, c.edit);
+
+		auto buffer = TokenBuffer::lex(program);
+		auto module = parser::parse_module(program);
+
+		auto relexed = lexer::relex(buffer, new_program, c.edit);
+		expect_same_tokens(buffer, TokenBuffer::lex(new_program));
+		EXPECT_LE(relexed.num_new_tokens, c.max_new_tokens);
+
+		usz reparsed = parser::reparse(module, new_program, c.edit, relexed);
+		expect_same_func_decls(module, parser::parse_module(new_program));
+		EXPECT_EQ(reparsed, c.expected_reparsed);
+	}
+}
+
+TEST(Incremental, RecoversFromAnInvalidEdit) {
+	struct TwoEdits {
+		std::string_view desc;
+		// Leaves the source with an error.
+		Edit breaking;
+		// Applied to the source |breaking| left, fixes it.
+		usz fix_offset;
+		std::string_view fix;
+	};
+	TwoEdits cases[] = {
+		{"half typed instruction", {offset_of("\tmov(r10"), 0, "mov(rax,"}, offset_of("\tmov(r10") + 8, " rbx);\n"},
+		{"half typed comment", {offset_of("fn third() {") + 12, 0, "/*"}, offset_of("fn third() {") + 14, "*/"},
+		{"broken signature", {offset_of("second") + 6, 1, ""}, offset_of("second") + 6, "("},
+	};
+
+	for (const auto &c : cases) {
+		SCOPED_TRACE(c.desc);
+		auto buffer = TokenBuffer::lex(program);
+		auto module = parser::parse_module(program);
+
+		// The tokens follow the source, the declarations stay as they were.
+		std::string broken = apply_edit(program, c.breaking);
+		Diagnostics diagnostics;
+		auto relexed = lexer::relex(buffer, broken, c.breaking, &diagnostics);
+		EXPECT_EQ(parser::reparse(module, broken, c.breaking, relexed, &diagnostics), 0u);
+		EXPECT_TRUE(diagnostics.has_errors());
+		EXPECT_EQ(buffer.offsets.back(), broken.size());
+		ASSERT_TRUE(module.damaged.has_value());
+		ASSERT_EQ(module.func_decls.size(), 3u);
+		EXPECT_EQ(module.func_decls[0]->name, "first");
+		EXPECT_EQ(module.func_decls[1]->name, "second");
+		EXPECT_EQ(module.func_decls[2]->name, "third");
+
+		// Fixing it brings everything back in sync.
+		Edit fixing{.offset = c.fix_offset, .removed = 0, .inserted = c.fix};
+		std::string fixed = apply_edit(broken, fixing);
+		Diagnostics fix_diagnostics;
+		relexed = lexer::relex(buffer, fixed, fixing, &fix_diagnostics);
+		parser::reparse(module, fixed, fixing, relexed, &fix_diagnostics);
+		EXPECT_FALSE(fix_diagnostics.has_errors());
+		EXPECT_FALSE(module.damaged.has_value());
+		expect_same_tokens(buffer, TokenBuffer::lex(fixed));
+		expect_same_func_decls(module, parser::parse_module(fixed));
+	}
+}
+
+TEST(Incremental, TokensTooLongToStore) {
+	std::string source = "a(" + std::string(TokenBuffer::max_token_len + 10, 'x') + ", b);";
+	Diagnostics diagnostics;
+	auto buffer = TokenBuffer::lex(source, &diagnostics);
+
+	// Past the length kept for the long token, but still inside it.
+	Edit edit{.offset = 2 + TokenBuffer::max_token_len + 5, .removed = 0, .inserted = "yy"};
+	std::string new_source = apply_edit(source, edit);
+	lexer::relex(buffer, new_source, edit, &diagnostics);
+	expect_same_tokens(buffer, TokenBuffer::lex(new_source, &diagnostics));
+
+	// Shrinking it back under the limit.
+	edit = {.offset = 2, .removed = 100, .inserted = ""};
+	source = apply_edit(new_source, edit);
+	lexer::relex(buffer, source, edit, &diagnostics);
+	expect_same_tokens(buffer, TokenBuffer::lex(source));
+	EXPECT_EQ(buffer.kind(2), TokenKind::Identifier);
+}
+
+TEST(Incremental, NumbersKeepTheirValue) {
+	std::string source = "a(0x10, 20); b(0b11, 1_000);";
+	auto buffer = TokenBuffer::lex(source);
+
+	Edit edit{.offset = source.find("20"), .removed = 2, .inserted = "0x2a"};
+	std::string new_source = apply_edit(source, edit);
+	lexer::relex(buffer, new_source, edit);
+
+	expect_same_tokens(buffer, TokenBuffer::lex(new_source));
+	EXPECT_EQ(buffer.number(4), 0x2au);
+}
+
+TEST(Incremental, RandomEditsMatchAFullRelex) {
+	// Edits made of chars the lexer knows, applied one after the other. Digits
+	// are left out since they easily end up in front of a letter, which is not
+	// a valid number.
+	std::string_view alphabet = "abcxyz \n\t(){};,";
+	std::string source = program;
+	auto buffer = TokenBuffer::lex(source);
+
+	u32 state = 42;
+	auto random = [&](usz bound) {
+		state = state * 1103515245 + 12345;
+		return usz(state >> 8) % bound;
+	};
+
+	for (usz round = 0; round < 500; ++round) {
+		std::string inserted;
+		for (usz i = random(6); i > 0; --i) inserted += alphabet[random(alphabet.size())];
+
+		usz offset = random(source.size() + 1);
+		usz removed = std::min(random(6), source.size() - offset);
+		Edit edit{.offset = offset, .removed = removed, .inserted = inserted};
+
+		std::string new_source = apply_edit(source, edit);
+		lexer::relex(buffer, new_source, edit);
+		source = std::move(new_source);
+
+		SCOPED_TRACE(round);
+		expect_same_tokens(buffer, TokenBuffer::lex(source));
+		if (HasFailure()) break;
+	}
+}
+
+} // namespace test
+} // namespace fiskas
@@ -0,0 +1,119 @@
+#include <bit>
+#include <cstring>
+#include <limits>
+
+#include "base.hh"
+#include "instruction_stream.hh"
+#include "x86_instructions/mov/mov.hh"
+#include "x86_instructions/table_encoder.hh"
+
+namespace fiskas {
+namespace parser {
+
+// Operands are stored as a single byte.
+static_assert(+common::RegName::Gs <= std::numeric_limits<u8>::max());
+
+auto str_of_form(Form form) -> std::string {
+	switch (form) {
+		case Form::NoOperands: return "NoOperands";
+		case Form::RegReg: return "RegReg";
+		case Form::RegMem: return "RegMem";
+		case Form::MemReg: return "MemReg";
+		case Form::RegImm: return "RegImm";
+	}
+	fiska_unreachable();
+}
+
+auto OperandReader::mem() -> common::MemRef {
+	u8 flags = curr[0];
+	common::MemRef mem{
+		.base = std::nullopt,
+		.index = std::nullopt,
+		.scale = common::MemRef::Scale(1 << (flags >> PackedMemRef::scale_shift)),
+		.disp = 0,
+	};
+	if (flags & PackedMemRef::has_base) mem.base = common::RegName(curr[1]);
+	if (flags & PackedMemRef::has_index) mem.index = common::RegName(curr[2]);
+	std::memcpy(&mem.disp, curr + 3, sizeof(mem.disp));
+
+	curr += packed_mem_ref_size;
+	return mem;
+}
+
+auto InstructionStreamBuilder::push_mem(const common::MemRef &mem) -> void {
+	u8 flags = u8(std::countr_zero(u8(+mem.scale)) << PackedMemRef::scale_shift);
+	if (mem.base) flags |= PackedMemRef::has_base;
+	if (mem.index) flags |= PackedMemRef::has_index;
+
+	std::array<u8, packed_mem_ref_size> packed{
+		flags,
+		u8(+mem.base.value_or(common::RegName::Rax)),
+		u8(+mem.index.value_or(common::RegName::Rax)),
+	};
+	std::memcpy(packed.data() + 3, &mem.disp, sizeof(mem.disp));
+	operands.insert(operands.end(), packed.begin(), packed.end());
+}
+
+auto InstructionStreamBuilder::push_imm(u64 imm) -> void {
+	std::array<u8, sizeof(imm)> packed;
+	std::memcpy(packed.data(), &imm, sizeof(imm));
+	operands.insert(operands.end(), packed.begin(), packed.end());
+}
+
+auto InstructionStreamBuilder::push(common::X86Mnemonic mnemonic, Form form, usz source_offset) -> void {
+	fiska_assert(source_offset <= std::numeric_limits<u32>::max(),
+			"Instruction offset '{}' does not fit in 32 bits", source_offset);
+	fiska_assert(operands.size() <= std::numeric_limits<u32>::max(),
+			"Operand pool of {} bytes is too big", operands.size());
+
+	if (size() % InstructionStream::checkpoint_interval == 0) operand_checkpoints.push_back(u32(operands.size()));
+	mnemonics.push_back(u8(+mnemonic));
+	forms.push_back(u8(+form));
+	source_offsets.push_back(u32(source_offset));
+}
+
+auto InstructionStreamBuilder::clear() -> void {
+	mnemonics.clear();
+	forms.clear();
+	source_offsets.clear();
+	operands.clear();
+	operand_checkpoints.clear();
+}
+
+auto InstructionStreamBuilder::freeze(Arena &arena, usz base_offset) const -> InstructionStream {
+	std::span<u32> relative_offsets = arena.copy<u32>(source_offsets);
+	for (u32 &offset : relative_offsets) {
+		fiska_assert(offset >= base_offset, "Instruction at '{}' is before its declaration", offset);
+		offset -= u32(base_offset);
+	}
+
+	// The operand offsets are found from the forms, which only works if every
+	// instruction pushed the operands of its form.
+	usz operands_size = 0;
+	for (u8 form : forms) operands_size += operand_size_of_form[form];
+	fiska_assert(operands_size == operands.size(),
+			"The forms take '{}' bytes of operands but '{}' were pushed", operands_size, operands.size());
+
+	return {
+		.mnemonics = arena.copy<u8>(mnemonics),
+		.forms = arena.copy<u8>(forms),
+		.source_offsets = relative_offsets,
+		.operands = arena.copy<u8>(operands),
+		.operand_checkpoints = arena.copy<u32>(operand_checkpoints),
+	};
+}
+
+auto encode_instruction(const InstructionStream &stream, usz idx) -> common::InstructionBytes {
+	auto instruction = x86_instruction::TableInstruction::read(stream.mnemonic(idx), stream.form(idx), stream.operand_reader(idx));
+
+	// The moves the spec leaves out, see |x86_instructions/instructions.def|.
+	if (instruction.mnemonic == common::X86Mnemonic::Mov
+		and (instruction.form == Form::RegImm or instruction.uses_segment_register()))
+	{
+		return x86_instruction::encode_mov(stream.form(idx), stream.operand_reader(idx));
+	}
+	return instruction.encode();
+}
+
+} // namespace parser
+} // namespace fiskas
@@ -0,0 +1,146 @@
+#ifndef __FISKA_ASSEMBLER_FISKAS_INSTRUCTION_STREAM_HH__
+#define __FISKA_ASSEMBLER_FISKAS_INSTRUCTION_STREAM_HH__
+
+#include <cstring>
+#include <span>
+#include <vector>
+
+#include "arena.hh"
+#include "base.hh"
+#include "x86_common.hh"
+
+namespace fiskas {
+namespace parser {
+
+// Kinds of the operands of an instruction, destination first. Together with
+// the mnemonic, the form picks the encoder and tells how the operands are laid
+// out in the operand pool.
+enum struct Form : u8 {
+	// e.g ret()
+	NoOperands,
+	// e.g mov(rax, rbx)
+	RegReg,
+	// e.g mov(rax, [rbx + 8])
+	RegMem,
+	// e.g mov([rbx + 8], rax)
+	MemReg,
+	// e.g mov(rax, 42)
+	RegImm,
+};
+// RegImm is the last form.
+constexpr usz num_forms = usz(Form::RegImm) + 1;
+auto str_of_form(Form form) -> std::string;
+
+// A memory operand takes |packed_mem_ref_size| bytes of the operand pool: its
+// flags, then the base, the index and the displacement.
+struct PackedMemRef {
+	constexpr static u8 has_base = 1 << 0;
+	constexpr static u8 has_index = 1 << 1;
+	// Log2 of the scale is in the two bits after the flags.
+	constexpr static u8 scale_shift = 2;
+};
+constexpr usz packed_mem_ref_size = 3 + sizeof(i32);
+
+// Reads the operands of one instruction, in order, out of the operand pool.
+struct OperandReader {
+	const u8 *curr{};
+
+public:
+	auto reg() -> common::RegName { return common::RegName(*curr++); }
+	auto mem() -> common::MemRef;
+	auto imm() -> u64 {
+		u64 value;
+		std::memcpy(&value, curr, sizeof(value));
+		curr += sizeof(value);
+		return value;
+	}
+};
+
+// Bytes the operands of each form take in the operand pool.
+constexpr std::array<u8, num_forms> operand_size_of_form = [] {
+	std::array<u8, num_forms> sizes{};
+	sizes[usz(Form::NoOperands)] = 0;
+	sizes[usz(Form::RegReg)] = 2;
+	sizes[usz(Form::RegMem)] = 1 + packed_mem_ref_size;
+	sizes[usz(Form::MemReg)] = 1 + packed_mem_ref_size;
+	sizes[usz(Form::RegImm)] = 1 + sizeof(u64);
+	return sizes;
+}();
+
+// The instructions of a function body stored as a structure of arrays. An
+// instruction is its mnemonic, its form and where it starts in the source,
+// plus its packed operands in the |operands| pool.
+//
+// The operands of a form always take the same room, so where they start is
+// only stored for every |checkpoint_interval|th instruction and found from the
+// forms of the ones in between. That comes down to 6.5 bytes per instruction
+// plus its operands: 6.5 bytes for a ret, 8.5 bytes for a mov between
+// registers, 14.5 bytes for a load or a store and 15.5 bytes for an immediate.
+//
+// Passes walk the columns they need linearly instead of chasing a pointer per
+// instruction. The columns live in the arena of the module the body belongs to.
+//
+// Source offsets are relative to the start of the function declaration, so
+// they stay valid when an edit moves the whole declaration around.
+struct InstructionStream {
+	std::span<const u8> mnemonics;
+	std::span<const u8> forms;
+	std::span<const u32> source_offsets;
+	std::span<const u8> operands;
+	// Where the operands of instructions 0, |checkpoint_interval|,
+	// 2 * |checkpoint_interval|, ... start in |operands|.
+	std::span<const u32> operand_checkpoints;
+
+public:
+	constexpr static usz checkpoint_interval = 8;
+	constexpr static usz fixed_bytes_per_instruction = sizeof(u8) + sizeof(u8) + sizeof(u32);
+
+	auto size() const -> usz { return mnemonics.size(); }
+	auto empty() const -> bool { return mnemonics.empty(); }
+	auto mnemonic(usz idx) const -> common::X86Mnemonic { return common::X86Mnemonic(mnemonics[idx]); }
+	auto form(usz idx) const -> Form { return Form(forms[idx]); }
+	auto source_offset(usz idx) const -> usz { return source_offsets[idx]; }
+	// Where the operands of instruction |idx| start in |operands|.
+	auto operand_offset(usz idx) const -> usz {
+		usz first = idx / checkpoint_interval * checkpoint_interval;
+		usz offset = operand_checkpoints[idx / checkpoint_interval];
+		for (usz i = first; i < idx; ++i) offset += operand_size_of_form[forms[i]];
+		return offset;
+	}
+	auto operand_reader(usz idx) const -> OperandReader { return {operands.data() + operand_offset(idx)}; }
+
+	// Memory taken by the stream, columns and operands included.
+	auto size_in_bytes() const -> usz {
+		return size() * fixed_bytes_per_instruction + operand_checkpoints.size() * sizeof(u32) + operands.size();
+	}
+};
+
+// Collects the instructions of a body while it is parsed, then copies them in
+// an arena. A parser keeps one around so the vectors are only allocated once.
+struct InstructionStreamBuilder {
+	std::vector<u8> mnemonics;
+	std::vector<u8> forms;
+	std::vector<u32> source_offsets;
+	std::vector<u8> operands;
+	std::vector<u32> operand_checkpoints;
+
+public:
+	// Start a new instruction. Its operands are pushed right after.
+	auto push(common::X86Mnemonic mnemonic, Form form, usz source_offset) -> void;
+	auto push_reg(common::RegName reg) -> void { operands.push_back(u8(+reg)); }
+	auto push_mem(const common::MemRef &mem) -> void;
+	auto push_imm(u64 imm) -> void;
+
+	auto size() const -> usz { return mnemonics.size(); }
+	auto clear() -> void;
+	// |base_offset| is where the declaration starts, see |InstructionStream|.
+	auto freeze(Arena &arena, usz base_offset) const -> InstructionStream;
+};
+
+// Machine code of one instruction. Doesn't allocate.
+auto encode_instruction(const InstructionStream &stream, usz idx) -> common::InstructionBytes;
+
+} // namespace parser
+} // namespace fiskas
+
+#endif // __FISKA_ASSEMBLER_FISKAS_INSTRUCTION_STREAM_HH__
@@ -0,0 +1,27 @@
+#include "base.hh"
+#include "block_encoder.hh"
+#include "jit.hh"
+
+namespace fiskas {
+
+auto jit_compile(const parser::FuncDecl &func_decl) -> JitFunction {
+	std::vector<u8> code;
+	parser::encode_block(func_decl.body, code);
+
+	// mmap doesn't take an empty mapping.
+	usz page_size = usz(sysconf(_SC_PAGESIZE));
+	usz mapped_size = std::max<usz>((code.size() + page_size - 1) / page_size, 1) * page_size;
+
+	void *ptr = mmap(nullptr, mapped_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	fiska_assert(ptr != MAP_FAILED, "Failed to map '{}' bytes for function '{}'", mapped_size, func_decl.name);
+	JitFunction func{ptr, mapped_size, code.size()};
+
+	std::ranges::copy(code, static_cast<u8 *>(ptr));
+	// The pages are never writable and executable at the same time. x86 keeps
+	// the instruction cache coherent, so there is nothing to flush.
+	fiska_assert(mprotect(ptr, mapped_size, PROT_READ | PROT_EXEC) == 0,
+		"Failed to make function '{}' executable", func_decl.name);
+	return func;
+}
+
+} // namespace fiskas
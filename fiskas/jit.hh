@@ -0,0 +1,62 @@
+#ifndef __FISKA_ASSEMBLER_FISKAS_JIT_HH__
+#define __FISKA_ASSEMBLER_FISKAS_JIT_HH__
+
+#include <span>
+#include <type_traits>
+#include <utility>
+
+#include "base.hh"
+#include "parser.hh"
+
+namespace fiskas {
+
+// Machine code of a function in pages of its own that can be executed but
+// not written. The pages stay mapped for as long as this object is alive, so
+// the pointers handed out by |as()| must not outlive it.
+struct JitFunction {
+	void *ptr = nullptr;
+	// Rounded up to whole pages.
+	usz mapped_size{};
+	usz code_size{};
+
+public:
+	JitFunction() = default;
+	JitFunction(void *ptr_, usz mapped_size_, usz code_size_)
+		: ptr(ptr_), mapped_size(mapped_size_), code_size(code_size_) {}
+
+	JitFunction(const JitFunction &) = delete;
+	auto operator=(const JitFunction &) -> JitFunction & = delete;
+
+	JitFunction(JitFunction &&other) noexcept
+		: ptr(std::exchange(other.ptr, nullptr)),
+		  mapped_size(std::exchange(other.mapped_size, 0)),
+		  code_size(std::exchange(other.code_size, 0)) {}
+
+	auto operator=(JitFunction &&other) noexcept -> JitFunction & {
+		std::swap(ptr, other.ptr);
+		std::swap(mapped_size, other.mapped_size);
+		std::swap(code_size, other.code_size);
+		return *this;
+	}
+
+	~JitFunction() {
+		if (ptr) munmap(ptr, mapped_size);
+	}
+
+	// The code as a function of type |Fn|, e.g as<i64(i64, i64)>(). It is
+	// called with the System V calling convention, so the function must
+	// follow it.
+	template <typename Fn>
+	requires std::is_function_v<Fn>
+	auto as() const -> Fn * { return reinterpret_cast<Fn *>(ptr); }
+
+	auto code() const -> std::span<const u8> { return {static_cast<const u8 *>(ptr), code_size}; }
+};
+
+// Encode |func_decl| into pages mapped read-write, then make them read and
+// execute only. No file or linker is involved.
+auto jit_compile(const parser::FuncDecl &func_decl) -> JitFunction;
+
+} // namespace fiskas
+
+#endif // __FISKA_ASSEMBLER_FISKAS_JIT_HH__
@@ -1,12 +1,9 @@
 #include "lexer.hh"
+#include "number_literal.hh"
 
 namespace fiskas {
 namespace lexer {
 
-const StringMap<TokenKind> Lexer::keywords = {
-	{"fn", TokenKind::Fn}
-};
-
 auto str_of_token_kind(TokenKind kind) -> std::string {
 	using enum TokenKind;
 	switch (kind) {
@@ -18,6 +15,11 @@ auto str_of_token_kind(TokenKind kind) -> std::string {
 		case RightBrace: return "<RightBrace>";
 		case Comma: return "<Comma>";
 		case SemiColon: return "<SemiColon>";
+		case LeftBracket: return "<LeftBracket>";
+		case RightBracket: return "<RightBracket>";
+		case Plus: return "<Plus>";
+		case Minus: return "<Minus>";
+		case Star: return "<Star>";
 		case Fn: return "<Fn>";
 		case Number: return "<Number>";
 		case Identifier: return "<Identifier>";
@@ -25,10 +27,30 @@ auto str_of_token_kind(TokenKind kind) -> std::string {
 	fiska_unreachable();
 }
 
+auto Lexer::eat_whitespace_and_comments() -> void {
+	while (true) {
+		eat_whitespace();
+		if (end() - curr < 2 or curr[0] != '/') return;
+
+		if (curr[1] == '/') {
+			eat_line_comment();
+
+		} else if (curr[1] == '*') {
+			if (not eat_block_comment()) {
+				report(error(pos(), "Unterminated block comment"));
+				advance_to(end());
+			}
+
+		} else {
+			return;
+		}
+	}
+}
+
 auto Lexer::next_token() -> Token {
-	eat_while(is_whitespace);
+	eat_whitespace_and_comments();
 
-	if (eof()) return Token::gen(TokenKind::Eof, 0, 0);
+	if (eof()) return Token::gen(TokenKind::Eof, pos(), 0);
 
 	usz start_offset = pos();
 
@@ -41,19 +63,50 @@ auto Lexer::next_token() -> Token {
 			case '}': return TokenKind::RightBrace;
 			case ',': return TokenKind::Comma;
 			case ';': return TokenKind::SemiColon;
+			case '[': return TokenKind::LeftBracket;
+			case ']': return TokenKind::RightBracket;
+			case '+': return TokenKind::Plus;
+			case '-': return TokenKind::Minus;
+			case '*': return TokenKind::Star;
 			default: return multi_char_token_kind(); 
 		}
 		fiska_unreachable();
 	}();
 
 	if (tok_kind == TokenKind::Identifier) {
-		std::string tok_literal = source_substring(start_offset, pos());
-		tok_kind = keywords.contains(tok_literal) 
-			? keywords.at(tok_literal) 
-			: TokenKind::Identifier;
+		tok_kind = keywords.get(source_substring(start_offset, pos()))
+			.value_or(TokenKind::Identifier);
 	}
 
-	return Token::gen(tok_kind, start_offset, pos() - start_offset);
+	Token tok = Token::gen(tok_kind, start_offset, pos() - start_offset);
+	if (tok_kind == TokenKind::Number) {
+		auto value = parse_number_literal(literal(tok));
+		if (not value) {
+			report(error(start_offset, "{} in number literal '{}'", str_of_number_error(value.error()), literal(tok)));
+			tok.kind = TokenKind::Invalid;
+		} else {
+			tok.value = *value;
+		}
+	}
+	return tok;
+}
+
+auto Lexer::location_of(usz offset) -> SourceLocation {
+	if (not line_table) line_table = LineTable::build(source);
+	return line_table->location_of(offset);
+}
+
+auto Lexer::report(Diagnostic diagnostic) -> void {
+	if (diagnostics) {
+		diagnostics->report(std::move(diagnostic));
+		return;
+	}
+	::detail::fiska_assert_impl(diagnostic.str(), __FILE__, __LINE__);
+}
+
+auto Lexer::str_of_location(usz offset) -> std::string {
+	SourceLocation loc = location_of(offset);
+	return fmt::format("{}:{}", loc.line, loc.col);
 }
 
 } // namespace lexer
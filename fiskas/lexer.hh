@@ -3,15 +3,21 @@
 
 #include <optional>
 #include <string>
-#include <functional>
+#include <string_view>
 
 #include "base.hh"
+#include "char_scan.hh"
+#include "diagnostics.hh"
+#include "line_table.hh"
 
 namespace fiskas {
 namespace lexer {
 
+// The cursor never owns the source code it walks over. The caller is responsible
+// for keeping the buffer alive (e.g a |MappedFile| or a std::string) for as long
+// as the cursor and the tokens it produced are in use.
 struct Cursor {
-    const std::string source{};
+    std::string_view source{};
     const char *curr{};
     char prev = ' ';
 
@@ -22,7 +28,8 @@ public:
 	static auto is_whitespace(char c) -> bool { return (c == '\n') or (c == ' ') or (c == '\t') or (c == '\r'); }
 
 public:
-    Cursor(std::string source_) : source(source_), curr(source.data()) {}
+    Cursor(std::string_view source_, usz start_offset = 0)
+        : source(source_), curr(source.data() + start_offset) {}
 
     // Current offset into the program source code string.
     auto pos() -> usz { return usz(curr - source.data()); }
@@ -49,13 +56,49 @@ public:
         return peek_char().value();
     }
 
-	auto eat_while(std::function<bool(char)> p) -> void {
+	template <typename Predicate>
+	auto eat_while(Predicate p) -> void {
 		while (peek_char().has_value() and p(peek_char_pnc())) {
 			next_char_pnc();
 		}
 	}
 
-	auto source_substring(usz start, usz end) -> std::string {
+	// Vectorized versions of |eat_while| for the character classes the lexer
+	// spends most of its time in.
+	auto eat_whitespace() -> void { advance_to(scan::skip_whitespace(curr, end())); }
+	auto eat_ident_continue() -> void { advance_to(scan::skip_ident_continue(curr, end())); }
+	auto eat_number() -> void { advance_to(scan::skip_number(curr, end())); }
+
+	// Comments are skipped without looking at every char: libc's memchr, which
+	// is vectorized, finds the char that can end them.
+	//
+	// Both expect |curr| to point at the opening '//' or '/*'.
+	auto eat_line_comment() -> void {
+		auto newline = static_cast<const char *>(std::memchr(curr + 2, '\n', usz(end() - curr - 2)));
+		advance_to(newline ? newline : end());
+	}
+	// Returns false if the comment is never closed, in which case nothing is eaten.
+	auto eat_block_comment() -> bool {
+		for (const char *p = curr + 2; p < end(); ++p) {
+			p = static_cast<const char *>(std::memchr(p, '*', usz(end() - p)));
+			if (not p or p + 1 == end()) return false;
+			if (p[1] == '/') {
+				advance_to(p + 2);
+				return true;
+			}
+		}
+		return false;
+	}
+
+	auto end() const -> const char * { return source.data() + source.size(); }
+
+	auto advance_to(const char *new_curr) -> void {
+		if (new_curr == curr) return;
+		prev = new_curr[-1];
+		curr = new_curr;
+	}
+
+	auto source_substring(usz start, usz end) const -> std::string_view {
 		usz len = end - start;
 		return source.substr(start, len);
 	}
@@ -72,6 +115,11 @@ enum struct TokenKind {
 	RightBrace,
 	SemiColon,
 	Comma,
+	LeftBracket,
+	RightBracket,
+	Plus,
+	Minus,
+	Star,
 
 	// Keywords.
 	Fn,
@@ -80,11 +128,25 @@ enum struct TokenKind {
 	Identifier,
 };
 auto str_of_token_kind(TokenKind kind) -> std::string;
+// For tables indexed by token kind. |Identifier| must stay the last kind.
+constexpr usz num_token_kinds = usz(+TokenKind::Identifier) + 1;
+
+// Byte range [offset, offset + len) of the source code.
+struct SourceSpan {
+	usz offset{};
+	usz len{};
+
+public:
+	auto end() const -> usz { return offset + len; }
+	auto contains(usz pos) const -> bool { return pos >= offset and pos < end(); }
+};
 
 struct Token {
 	TokenKind kind = TokenKind::Invalid;
 	usz offset{};
 	usz len{};
+	// Value of |Number| tokens.
+	u64 value{};
 
 public:
 	static auto gen(TokenKind kind, usz offset, usz len) -> Token {
@@ -97,25 +159,61 @@ public:
 
 struct Lexer : Cursor {
 public:
-	static const StringMap<TokenKind> keywords;
+	constexpr static auto keywords = make_static_string_map<TokenKind>({
+		{"fn", TokenKind::Fn},
+	});
 
 public:
-	Lexer(std::string source) : Cursor(source) {}
+	// Only built when a diagnostic asks for a line and a column, so that lexing
+	// a valid program never pays for it.
+	std::optional<LineTable> line_table;
+	// Where errors go. Without one, the first error ends the process.
+	Diagnostics *diagnostics = nullptr;
+
+public:
+	Lexer(std::string_view source, usz start_offset = 0) : Cursor(source, start_offset) {}
 
 	auto next_token() -> Token;
+	// Skip everything that doesn't make a token: whitespace, '//' line comments
+	// and '/* */' block comments. Block comments don't nest.
+	auto eat_whitespace_and_comments() -> void;
+
+	auto location_of(usz offset) -> SourceLocation;
+	// "line:col" of |offset|, for error messages.
+	auto str_of_location(usz offset) -> std::string;
+
+	template <typename... Args>
+	auto error(usz offset, fmt::format_string<Args...> fmt, Args&&... args) -> Diagnostic {
+		return {
+			.offset = offset,
+			.location = location_of(offset),
+			.message = fmt::format(fmt, std::forward<Args>(args)...),
+		};
+	}
+	// Hand |diagnostic| to |diagnostics|, or exit if there is none.
+	auto report(Diagnostic diagnostic) -> void;
+
+	// View of the source code a token was lexed from. No allocation happens here.
+	auto literal(const Token &tok) const -> std::string_view {
+		return source_substring(tok.offset, tok.offset + tok.len);
+	}
 
 	auto multi_char_token_kind() -> TokenKind {
 		if (is_number(prev)) {
-			eat_while(is_number);
+			eat_number();
+			// Base prefixes, hex digits and separators. Anything else that could
+			// continue an identifier is rejected when the value is parsed.
+			if (peek_char().has_value() and is_ident_continue(peek_char_pnc())) eat_ident_continue();
 			return TokenKind::Number;
 		}
 
 		if (is_ident_start(prev)) {
-			eat_while(is_ident_continue);
+			eat_ident_continue();
 			return TokenKind::Identifier;
 		}
 
-		fiska_unreachable("Char '{}' does not start a number nor an identifier", prev);
+		report(error(pos() - 1, "Char '{}' does not start a token", prev));
+		return TokenKind::Invalid;
 	}
 };
 
@@ -1,13 +1,18 @@
 #include <gtest/gtest.h>
 
+#include "char_scan.hh"
 #include "lexer.hh"
+#include "line_table.hh"
+#include "number_literal.hh"
+#include "structural_index.hh"
+#include "token_buffer.hh"
 
 namespace fiskas {
 namespace lexer {
 namespace test {
 
 auto check_toks_eq(std::string_view program, std::vector<Token> expected_toks) -> void {
-	Lexer lexer{std::string(program)};
+	Lexer lexer{program};
 	for (usz i = 0; i < expected_toks.size(); ++i) {
 		auto tok = lexer.next_token();
 		EXPECT_EQ(expected_toks[i].kind, tok.kind);
@@ -119,6 +124,451 @@ TEST(SmokeTest, SmokeTest_3) {
 	});
 }
 
+auto literals_of(std::string_view source) -> std::vector<std::string_view> {
+	Lexer lexer{source};
+	std::vector<std::string_view> literals;
+	for (auto tok = lexer.next_token(); tok.kind != TokenKind::Eof; tok = lexer.next_token()) {
+		literals.push_back(lexer.literal(tok));
+	}
+	return literals;
+}
+
+TEST(Comments, AreSkipped) {
+	std::string_view program =
+		"// One-line comments should be ignored.\n"
+		"//\n"
+		"//// Segment registers\n"
+		"fn start() { // trailing comment\n"
+		"\tmov(rax, /* inline */ rbx);\n"
+		"\t/* block comment\n"
+		"\t   spanning * several / lines **/\n"
+		"\tret();/**/}\n"
+		"// comment at the end of the file without a newline";
+
+	std::vector<std::string_view> expected = {
+		"fn", "start", "(", ")", "{",
+		"mov", "(", "rax", ",", "rbx", ")", ";",
+		"ret", "(", ")", ";", "}",
+	};
+	EXPECT_EQ(literals_of(program), expected);
+}
+
+TEST(Comments, OnlyComments) {
+	EXPECT_TRUE(literals_of("//").empty());
+	EXPECT_TRUE(literals_of("/**/").empty());
+	EXPECT_TRUE(literals_of("// a\n/* b */\n\n// c\n").empty());
+}
+
+TEST(Comments, CommentStartsAreNotTokenChars) {
+	std::vector<std::string_view> expected = {"a", "b", "c"};
+	EXPECT_EQ(literals_of("a/*/ */b//*\nc"), expected);
+}
+
+TEST(Comments, UnterminatedBlockComment) {
+	Lexer lexer{"a /* b *"};
+	lexer.next_token();
+	lexer.curr += 1;
+	EXPECT_FALSE(lexer.eat_block_comment());
+	EXPECT_EQ(lexer.pos(), 2u);
+}
+
+TEST(Diagnostics, LexerKeepsGoingAfterAnError) {
+	std::string_view program = "a $ 0x_ b\n/* c";
+
+	Diagnostics diagnostics;
+	Lexer lexer{program};
+	lexer.diagnostics = &diagnostics;
+
+	std::vector<TokenKind> kinds;
+	for (Token tok = lexer.next_token(); tok.kind != TokenKind::Eof; tok = lexer.next_token()) {
+		kinds.push_back(tok.kind);
+	}
+
+	using enum TokenKind;
+	EXPECT_EQ(kinds, (std::vector{Identifier, Invalid, Invalid, Identifier}));
+	ASSERT_EQ(diagnostics.size(), 3u);
+	EXPECT_EQ(diagnostics.errors[0].str(), "1:3: error: Char '$' does not start a token");
+	EXPECT_EQ(diagnostics.errors[1].str(), "1:5: error: Missing digits in number literal '0x_'");
+	EXPECT_EQ(diagnostics.errors[2].str(), "2:1: error: Unterminated block comment");
+}
+
+TEST(NumberLiteral, Bases) {
+	EXPECT_EQ(parse_number_literal("0"), 0u);
+	EXPECT_EQ(parse_number_literal("7"), 7u);
+	EXPECT_EQ(parse_number_literal("10123123"), 10123123u);
+	EXPECT_EQ(parse_number_literal("0x7fffffff"), 0x7fffffffu);
+	EXPECT_EQ(parse_number_literal("0XDEADbeef"), 0xdeadbeefu);
+	EXPECT_EQ(parse_number_literal("0b1010"), 0b1010u);
+	EXPECT_EQ(parse_number_literal("0B1"), 1u);
+	EXPECT_EQ(parse_number_literal("0x0"), 0u);
+	EXPECT_EQ(parse_number_literal("0b0"), 0u);
+	EXPECT_EQ(parse_number_literal("007"), 7u);
+}
+
+TEST(NumberLiteral, Separators) {
+	EXPECT_EQ(parse_number_literal("1_000_000"), 1000000u);
+	EXPECT_EQ(parse_number_literal("0x7fff_ffff"), 0x7fffffffu);
+	EXPECT_EQ(parse_number_literal("0b1010_1010"), 0b10101010u);
+	EXPECT_EQ(parse_number_literal("0x_ff"), 0xffu);
+	EXPECT_EQ(parse_number_literal("0_0"), 0u);
+}
+
+TEST(NumberLiteral, Limits) {
+	EXPECT_EQ(parse_number_literal("18446744073709551615"), ~u64(0));
+	EXPECT_EQ(parse_number_literal("0xffffffffffffffff"), ~u64(0));
+	EXPECT_EQ(parse_number_literal("0x0000000000000000000ffffffffffffffff"), ~u64(0));
+	EXPECT_EQ(parse_number_literal("0b" + std::string(64, '1')), ~u64(0));
+	EXPECT_EQ(parse_number_literal("0b1" + std::string(63, '0')), u64(1) << 63);
+
+	EXPECT_EQ(parse_number_literal("18446744073709551616"), std::unexpected(NumberError::Overflow));
+	EXPECT_EQ(parse_number_literal("99999999999999999999"), std::unexpected(NumberError::Overflow));
+	EXPECT_EQ(parse_number_literal("100000000000000000000"), std::unexpected(NumberError::Overflow));
+	EXPECT_EQ(parse_number_literal("0x1_0000_0000_0000_0000"), std::unexpected(NumberError::Overflow));
+	EXPECT_EQ(parse_number_literal("0b1" + std::string(64, '0')), std::unexpected(NumberError::Overflow));
+}
+
+TEST(NumberLiteral, Errors) {
+	EXPECT_EQ(parse_number_literal("0x"), std::unexpected(NumberError::NoDigits));
+	EXPECT_EQ(parse_number_literal("0b__"), std::unexpected(NumberError::NoDigits));
+	EXPECT_EQ(parse_number_literal("0b102"), std::unexpected(NumberError::InvalidDigit));
+	EXPECT_EQ(parse_number_literal("12ab"), std::unexpected(NumberError::InvalidDigit));
+	EXPECT_EQ(parse_number_literal("0xfg"), std::unexpected(NumberError::InvalidDigit));
+	EXPECT_EQ(parse_number_literal("0x"s + char(0xff)), std::unexpected(NumberError::InvalidDigit));
+	EXPECT_EQ(parse_number_literal("1234567890123456789012345z"), std::unexpected(NumberError::InvalidDigit));
+}
+
+TEST(NumberLiteral, MatchesAPerDigitConversion) {
+	u64 state = 99;
+	for (usz i = 0; i < 10000; ++i) {
+		state = state * 6364136223846793005 + 1442695040888963407;
+		u64 value = state >> (state % 64);
+
+		EXPECT_EQ(parse_number_literal(fmt::format("{}", value)), value);
+		EXPECT_EQ(parse_number_literal(fmt::format("0x{:x}", value)), value);
+		EXPECT_EQ(parse_number_literal(fmt::format("0x{:X}", value)), value);
+		EXPECT_EQ(parse_number_literal(fmt::format("0b{:b}", value)), value);
+	}
+}
+
+TEST(NumberLiteral, TokensCarryTheirValue) {
+	Lexer lexer{"mov(rax, 0x7fff_ffff); mov(rbx, 1_000_000)"};
+	std::vector<u64> values;
+	for (auto tok = lexer.next_token(); tok.kind != TokenKind::Eof; tok = lexer.next_token()) {
+		if (tok.kind == TokenKind::Number) values.push_back(tok.value);
+	}
+	EXPECT_EQ(values, (std::vector<u64>{0x7fffffff, 1000000}));
+
+	auto buffer = TokenBuffer::lex("mov(rax, 0b1010)");
+	ASSERT_EQ(buffer.kind(4), TokenKind::Number);
+	EXPECT_EQ(buffer.number(4), 0b1010u);
+	EXPECT_EQ(buffer.lengths[4], 6u);
+}
+
+TEST(ZeroCopy, LiteralsPointIntoTheSource) {
+	std::string program = "fn start() { mov(rax, rbx); }";
+	Lexer lexer{program};
+
+	std::vector<std::string_view> literals;
+	for (auto tok = lexer.next_token(); tok.kind != TokenKind::Eof; tok = lexer.next_token()) {
+		auto literal = lexer.literal(tok);
+		EXPECT_GE(literal.data(), program.data());
+		EXPECT_LE(literal.data() + literal.size(), program.data() + program.size());
+		literals.push_back(literal);
+	}
+
+	std::vector<std::string_view> expected = {
+		"fn", "start", "(", ")", "{", "mov", "(", "rax", ",", "rbx", ")", ";", "}"
+	};
+	EXPECT_EQ(literals, expected);
+}
+
+TEST(ZeroCopy, LexMappedFile) {
+	fs::path path = fs::temp_directory_path() / "fiskas_lexer_test_mapped_file.asm++";
+	std::string program = "fn main() { mov(r8, r9); }";
+	File::write(program.data(), program.size(), path);
+
+	MappedFile file = File::map(path);
+	EXPECT_EQ(file.view(), program);
+
+	Lexer lexer{file.view()};
+	EXPECT_EQ(lexer.next_token().kind, TokenKind::Fn);
+	auto name = lexer.next_token();
+	EXPECT_EQ(lexer.literal(name), "main");
+	EXPECT_EQ(lexer.literal(name).data(), file.view().data() + 3);
+
+	fs::remove(path);
+}
+
+TEST(ZeroCopy, MapEmptyFile) {
+	fs::path path = fs::temp_directory_path() / "fiskas_lexer_test_empty_file.asm++";
+	std::string empty;
+	File::write(empty.data(), empty.size(), path);
+
+	MappedFile file = File::map(path);
+	EXPECT_TRUE(file.view().empty());
+	EXPECT_EQ(Lexer{file.view()}.next_token().kind, TokenKind::Eof);
+
+	fs::remove(path);
+}
+
+auto supported_isas() -> std::vector<scan::Isa> {
+	std::vector<scan::Isa> isas;
+	for (auto isa : {scan::Isa::Scalar, scan::Isa::Sse2, scan::Isa::Avx2}) {
+		if (scan::is_isa_supported(isa)) isas.push_back(isa);
+	}
+	return isas;
+}
+
+TEST(CharScan, AllIsasAgreeWithTheScalarPredicates) {
+	using ScanFn = auto (*)(const char *, const char *) -> const char *;
+	std::pair<ScanFn, bool (*)(char)> scanners[] = {
+		{scan::skip_whitespace, Cursor::is_whitespace},
+		{scan::skip_ident_continue, Cursor::is_ident_continue},
+		{scan::skip_number, Cursor::is_number},
+	};
+
+	// Runs of in-class chars of every length up to a few vectors, terminated by
+	// every possible byte value, so both the vector loop and the scalar tail are hit.
+	std::string fill[] = {" \t\r\n", "aZ_09zA", "0123456789"};
+	auto original_isa = scan::active_isa();
+	for (auto isa : supported_isas()) {
+		scan::force_isa(isa);
+		for (usz s = 0; s < std::size(scanners); ++s) {
+			auto [scan_fn, in_class] = scanners[s];
+			for (usz run = 0; run < 100; ++run) {
+				for (int terminator = 0; terminator < 256; ++terminator) {
+					std::string input;
+					for (usz i = 0; i < run; ++i) input += fill[s][i % fill[s].size()];
+					input += char(terminator);
+					input += "0a ";
+
+					usz expected = run + (in_class(char(terminator)) ? 1 : 0);
+					if (in_class(char(terminator))) {
+						const char *p = input.data() + expected;
+						while (p < input.data() + input.size() and in_class(*p)) ++p;
+						expected = usz(p - input.data());
+					}
+
+					auto got = scan_fn(input.data(), input.data() + input.size());
+					ASSERT_EQ(usz(got - input.data()), expected)
+						<< "isa=" << scan::str_of_isa(isa) << " run=" << run << " terminator=" << terminator;
+				}
+			}
+		}
+	}
+	scan::force_isa(original_isa);
+}
+
+TEST(CharScan, StopsAtTheEndOfTheBuffer) {
+	std::string input(70, ' ');
+	auto original_isa = scan::active_isa();
+	for (auto isa : supported_isas()) {
+		scan::force_isa(isa);
+		for (usz len = 0; len <= input.size(); ++len) {
+			EXPECT_EQ(scan::skip_whitespace(input.data(), input.data() + len), input.data() + len);
+		}
+	}
+	scan::force_isa(original_isa);
+}
+
+TEST(CharScan, LexerProducesTheSameTokensOnEveryIsa) {
+	std::string program = R"(
+	fn a_very_long_function_name_that_spans_more_than_one_vector_width() {
+		mov(RAX,                                                  RBX);
+		mov(R8, 00000000000000000000000000012345678901234567890);
+	}
+	)";
+
+	auto lex_all = [&] {
+		std::vector<std::pair<TokenKind, std::string_view>> toks;
+		Lexer lexer{program};
+		for (auto tok = lexer.next_token(); tok.kind != TokenKind::Eof; tok = lexer.next_token()) {
+			toks.emplace_back(tok.kind, lexer.literal(tok));
+		}
+		return toks;
+	};
+
+	auto original_isa = scan::active_isa();
+	scan::force_isa(scan::Isa::Scalar);
+	auto expected = lex_all();
+	for (auto isa : supported_isas()) {
+		scan::force_isa(isa);
+		EXPECT_EQ(lex_all(), expected) << "isa=" << scan::str_of_isa(isa);
+	}
+	scan::force_isa(original_isa);
+}
+
+TEST(StructuralIndex, MatchesAByteByByteScan) {
+	// Deterministic soup of the interesting chars and filler, long enough to
+	// cover several full blocks and a partial one.
+	std::string_view alphabet = "(){}[];,+-/*\n a_1";
+	std::string source;
+	u32 state = 12345;
+	for (usz i = 0; i < 64 * 9 + 37; ++i) {
+		state = state * 1103515245 + 12345;
+		source += alphabet[(state >> 16) % alphabet.size()];
+	}
+
+	auto original_isa = scan::active_isa();
+	for (auto isa : supported_isas()) {
+		scan::force_isa(isa);
+		auto index = scan::StructuralIndex::build(source);
+		ASSERT_EQ(index.size, source.size());
+
+		for (usz i = 0; i < source.size(); ++i) {
+			char c = source[i];
+			bool structural = std::string_view("(){}[];,+-*").find(c) != std::string_view::npos;
+			bool comment_start = c == '/' and i + 1 < source.size()
+				and (source[i + 1] == '/' or source[i + 1] == '*');
+
+			EXPECT_EQ(index.is_set(index.structural, i), structural) << i;
+			EXPECT_EQ(index.is_set(index.braces, i), c == '{' or c == '}') << i;
+			EXPECT_EQ(index.is_set(index.newlines, i), c == '\n') << i;
+			EXPECT_EQ(index.is_set(index.comment_starts, i), comment_start) << i;
+		}
+	}
+	scan::force_isa(original_isa);
+}
+
+TEST(StructuralIndex, NextSet) {
+	std::string source(200, ' ');
+	source[3] = ';';
+	source[64] = '{';
+	source[199] = '}';
+
+	auto index = scan::StructuralIndex::build(source);
+	EXPECT_EQ(index.next_structural(0), 3u);
+	EXPECT_EQ(index.next_structural(3), 3u);
+	EXPECT_EQ(index.next_structural(4), 64u);
+	EXPECT_EQ(index.next_structural(65), 199u);
+	EXPECT_EQ(index.next_structural(200), 200u);
+	EXPECT_EQ(index.next_newline(0), 200u);
+	EXPECT_EQ(index.next_comment_start(0), 200u);
+}
+
+TEST(StructuralIndex, CommentStartAcrossBlocks) {
+	std::string source(130, ' ');
+	source[63] = '/';
+	source[64] = '*';
+	source[127] = '/';
+	source[128] = '/';
+
+	auto index = scan::StructuralIndex::build(source);
+	EXPECT_EQ(index.next_comment_start(0), 63u);
+	EXPECT_EQ(index.next_comment_start(64), 127u);
+	EXPECT_EQ(index.next_comment_start(128), 130u);
+}
+
+TEST(TokenBuffer, MatchesTheTokenStream) {
+	std::string program = R"(
+	fn start() {
+		mov(RAX, RBX);
+		mov(R8, 10123123);
+	}
+	)";
+
+	auto buffer = TokenBuffer::lex(program);
+	Lexer lexer{program};
+	for (usz i = 0; i < buffer.size() - 1; ++i) {
+		auto tok = lexer.next_token();
+		EXPECT_EQ(buffer.kind(i), tok.kind);
+		EXPECT_EQ(buffer.token(i).offset, tok.offset);
+		EXPECT_EQ(buffer.token(i).len, tok.len);
+	}
+	EXPECT_EQ(lexer.next_token().kind, TokenKind::Eof);
+	EXPECT_EQ(buffer.kind(buffer.size() - 1), TokenKind::Eof);
+	EXPECT_EQ(buffer.token(buffer.size() - 1).offset, program.size());
+}
+
+TEST(TokenBuffer, InternsIdentifiers) {
+	std::string program = "fn f() { mov(rax, rbx); mov(rbx, rax); }";
+	auto buffer = TokenBuffer::lex(program);
+
+	// fn f ( ) { mov ( rax , rbx ) ; mov ( rbx , rax ) ; } <eof>
+	EXPECT_EQ(buffer.ident(1), "f");
+	EXPECT_EQ(buffer.ident_id(5), buffer.ident_id(12));
+	EXPECT_EQ(buffer.ident_id(7), buffer.ident_id(16));
+	EXPECT_EQ(buffer.ident_id(9), buffer.ident_id(14));
+	EXPECT_NE(buffer.ident_id(7), buffer.ident_id(9));
+	EXPECT_EQ(buffer.identifiers.size(), 4u);
+
+	// The identifiers outlive the source.
+	program.assign(program.size(), '#');
+	EXPECT_EQ(buffer.ident(7), "rax");
+	EXPECT_EQ(buffer.identifiers.find("mov"), buffer.ident_id(5));
+}
+
+TEST(TokenBuffer, IsSmallerThanTokens) {
+	// A |Token| carries the value of numbers, the buffer keeps them apart.
+	EXPECT_EQ(sizeof(Token), 32u);
+	EXPECT_EQ(TokenBuffer::bytes_per_token, 11u);
+	EXPECT_LT(TokenBuffer::bytes_per_token * 2, sizeof(Token));
+}
+
+TEST(TokenBuffer, ReportsTokensTooLongToStore) {
+	std::string program = "mov(" + std::string(TokenBuffer::max_token_len + 10, 'a') + ", rbx);";
+
+	Diagnostics diagnostics;
+	auto buffer = TokenBuffer::lex(program, &diagnostics);
+	ASSERT_EQ(diagnostics.size(), 1u);
+	EXPECT_EQ(diagnostics.errors[0].offset, 4u);
+	EXPECT_EQ(diagnostics.errors[0].message, "Token is 65545 bytes long, the limit is 65535");
+
+	// mov ( <invalid> , rbx ) ; <eof>
+	ASSERT_EQ(buffer.size(), 8u);
+	EXPECT_EQ(buffer.kind(2), TokenKind::Invalid);
+	EXPECT_EQ(buffer.end_of(2), program.find(','));
+	EXPECT_EQ(buffer.ident(4), "rbx");
+}
+
+TEST(LineTable, MatchesAByteByByteScan) {
+	std::string_view alphabet = "\n\ta_1 ";
+	std::string source;
+	u32 state = 777;
+	for (usz i = 0; i < 64 * 5 + 19; ++i) {
+		state = state * 1103515245 + 12345;
+		source += alphabet[(state >> 16) % alphabet.size()];
+	}
+
+	auto original_isa = scan::active_isa();
+	for (auto isa : supported_isas()) {
+		scan::force_isa(isa);
+		auto table = LineTable::build(source);
+
+		usz line = 1;
+		usz col = 1;
+		for (usz i = 0; i <= source.size(); ++i) {
+			auto loc = table.location_of(i);
+			EXPECT_EQ(loc.line, line) << i;
+			EXPECT_EQ(loc.col, col) << i;
+
+			if (i < source.size() and source[i] == '\n') {
+				++line;
+				col = 1;
+			} else {
+				++col;
+			}
+		}
+		EXPECT_EQ(table.num_lines(), line);
+	}
+	scan::force_isa(original_isa);
+}
+
+TEST(LineTable, IsOnlyBuiltOnDemand) {
+	std::string_view source =
+		"fn main() {\n"
+		"\tmov(rax, rbx);\n"
+		"}\n";
+
+	Lexer lexer(source);
+	while (lexer.next_token().kind != TokenKind::Eof);
+	EXPECT_FALSE(lexer.line_table.has_value());
+
+	EXPECT_EQ(lexer.str_of_location(source.find("rbx")), "2:11");
+	EXPECT_TRUE(lexer.line_table.has_value());
+	EXPECT_EQ(lexer.str_of_location(source.find('}')), "3:1");
+	EXPECT_EQ(lexer.str_of_location(0), "1:1");
+}
 
 }
 } // namespace lexer
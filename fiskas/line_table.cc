@@ -0,0 +1,84 @@
+#include <limits>
+
+#include "base.hh"
+#include "char_scan.hh"
+#include "line_table.hh"
+#include "simd.hh"
+
+namespace fiskas {
+namespace lexer {
+
+namespace {
+
+// Append the offset of the byte following each '\n' in [begin, end) to
+// |line_starts|. |base| is the offset of |begin| in the source.
+using CollectFn = auto (*)(const char *begin, const char *end, usz base, std::vector<u32> &line_starts) -> void;
+
+auto scalar_collect(const char *begin, const char *end, usz base, std::vector<u32> &line_starts) -> void {
+	for (const char *p = begin; p < end; ++p) {
+		if (*p == '\n') line_starts.push_back(u32(base + usz(p - begin) + 1));
+	}
+}
+
+#if FISKA_SIMD_X86
+#define FISKA_DEFINE_COLLECT(name, V, target)                                                 \
+	target auto name(const char *begin, const char *end, usz base,                             \
+			std::vector<u32> &line_starts) -> void {                                           \
+		const char *p = begin;                                                                 \
+		for (; usz(end - p) >= V::width; p += V::width) {                                      \
+			u32 newlines = V::mask(V::eq(V::load(p), '\n'));                                   \
+			usz offset = base + usz(p - begin) + 1;                                            \
+			for (; newlines != 0; newlines &= newlines - 1) {                                  \
+				line_starts.push_back(u32(offset + usz(__builtin_ctz(newlines))));             \
+			}                                                                                  \
+		}                                                                                      \
+		scalar_collect(p, end, base + usz(p - begin), line_starts);                            \
+	}
+
+FISKA_DEFINE_COLLECT(sse2_collect, simd::Sse2, )
+FISKA_DEFINE_COLLECT(avx2_collect, simd::Avx2, [[gnu::target("avx2")]])
+
+#undef FISKA_DEFINE_COLLECT
+#endif // FISKA_SIMD_X86
+
+auto collect_fn_of_isa(scan::Isa isa) -> CollectFn {
+	switch (isa) {
+		case scan::Isa::Scalar: return scalar_collect;
+#if FISKA_SIMD_X86
+		case scan::Isa::Sse2: return sse2_collect;
+		case scan::Isa::Avx2: return avx2_collect;
+#else
+		case scan::Isa::Sse2:
+		case scan::Isa::Avx2:
+			fiska_unreachable("SIMD scanners are only available on x86");
+#endif
+	}
+	fiska_unreachable();
+}
+
+} // namespace
+
+auto LineTable::build(std::string_view source) -> LineTable {
+	fiska_assert(source.size() <= std::numeric_limits<u32>::max(),
+			"Line offsets are 32 bits, source is '{}' bytes long", source.size());
+
+	LineTable table;
+	table.size = source.size();
+	table.line_starts.push_back(0);
+	collect_fn_of_isa(scan::active_isa())(source.data(), source.data() + source.size(), 0, table.line_starts);
+	return table;
+}
+
+auto LineTable::location_of(usz offset) const -> SourceLocation {
+	fiska_assert(offset <= size, "Offset '{}' is past the end of the source", offset);
+
+	// The line of |offset| is the last one starting at or before it.
+	auto line = std::upper_bound(line_starts.begin(), line_starts.end(), offset) - 1;
+	return {
+		.line = usz(line - line_starts.begin()) + 1,
+		.col = offset - *line + 1,
+	};
+}
+
+} // namespace lexer
+} // namespace fiskas
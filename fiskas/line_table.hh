@@ -0,0 +1,37 @@
+#ifndef __FISKA_ASSEMBLER_FISKAS_LINE_TABLE_HH__
+#define __FISKA_ASSEMBLER_FISKAS_LINE_TABLE_HH__
+
+#include <vector>
+
+#include "base.hh"
+
+namespace fiskas {
+namespace lexer {
+
+// 1-based line and column of a byte of the source. Columns count bytes, a tab
+// is one column like any other char.
+struct SourceLocation {
+	usz line{};
+	usz col{};
+};
+
+// Offsets of the first byte of every line of the source. Tokens only remember
+// their byte offset, so this is what turns an offset back into a line and a
+// column when a diagnostic needs one. Building it is a single vectorized pass
+// over the source, which is why the lexer only does it on the first error.
+struct LineTable {
+	// Always starts with 0, the offset of the first line.
+	std::vector<u32> line_starts;
+	usz size{};
+
+public:
+	static auto build(std::string_view source) -> LineTable;
+
+	auto num_lines() const -> usz { return line_starts.size(); }
+	auto location_of(usz offset) const -> SourceLocation;
+};
+
+} // namespace lexer
+} // namespace fiskas
+
+#endif // __FISKA_ASSEMBLER_FISKAS_LINE_TABLE_HH__
@@ -0,0 +1,163 @@
+#include "base.hh"
+#include "number_literal.hh"
+
+namespace fiskas {
+namespace lexer {
+
+namespace {
+
+// A u64 is handled as 8 lanes of one byte. The first char of a chunk sits in
+// the lowest byte since x86 is little endian.
+constexpr u64 ones = 0x0101010101010101;
+constexpr u64 high_bits = 0x8080808080808080;
+
+auto load_chunk(const char *p) -> u64 {
+	u64 chunk;
+	std::memcpy(&chunk, p, sizeof chunk);
+	return chunk;
+}
+
+// 0x80 in every byte of |chunk| that lies in [lo, hi]. All bytes must be ASCII,
+// which guarantees that none of the additions carries into the next byte.
+constexpr auto bytes_in_range(u64 chunk, u8 lo, u8 hi) -> u64 {
+	u64 at_least_lo = chunk + ones * u64(0x80 - lo);
+	u64 above_hi = chunk + ones * u64(0x80 - (hi + 1));
+	return at_least_lo & ~above_hi & high_bits;
+}
+
+constexpr auto is_ascii(u64 chunk) -> bool { return (chunk & high_bits) == 0; }
+
+constexpr auto all_decimal_digits(u64 chunk) -> bool {
+	return is_ascii(chunk) and bytes_in_range(chunk, '0', '9') == high_bits;
+}
+
+constexpr auto all_binary_digits(u64 chunk) -> bool {
+	return is_ascii(chunk) and bytes_in_range(chunk, '0', '1') == high_bits;
+}
+
+constexpr auto all_hex_digits(u64 chunk) -> bool {
+	// Setting bit 5 maps 'A'-'F' onto 'a'-'f' and leaves the digits alone.
+	return is_ascii(chunk)
+		and (bytes_in_range(chunk, '0', '9') | bytes_in_range(chunk | (ones * 0x20), 'a', 'f')) == high_bits;
+}
+
+// Value of 8 decimal digits, in 3 multiplications instead of 8.
+constexpr auto decimal_chunk_value(u64 chunk) -> u64 {
+	chunk -= ones * '0';
+	// Every 16 bit lane holds 10 * first + second digit in its low byte.
+	chunk = (chunk * 10) + (chunk >> 8);
+	// Combine pairs of lanes into 4 digit values, then those into the result.
+	constexpr u64 mask = 0x000000ff000000ff;
+	constexpr u64 mul1 = 100 + (u64(1000000) << 32);
+	constexpr u64 mul2 = 1 + (u64(10000) << 32);
+	return (((chunk & mask) * mul1) + (((chunk >> 16) & mask) * mul2)) >> 32;
+}
+
+// Value of 8 hex digits.
+constexpr auto hex_chunk_value(u64 chunk) -> u64 {
+	// Letters have bit 6 set and their low nibble is 1 to 6, so they only need 9 more.
+	u64 nibbles = (chunk & (ones * 0x0f)) + ((chunk >> 6) & ones) * 9;
+	// Pack the nibbles: 2 per byte, then 4 per u16, then all 8 in a u32, with the
+	// first digit ending up in the most significant position.
+	u64 bytes = ((nibbles & 0x000f000f000f000f) << 4) | ((nibbles & 0x0f000f000f000f00) >> 8);
+	u64 halves = ((bytes & 0x000000ff000000ff) << 8) | ((bytes & 0x00ff000000ff0000) >> 16);
+	return ((halves & 0x000000000000ffff) << 16) | ((halves & 0x0000ffff00000000) >> 32);
+}
+
+// Value of 8 binary digits.
+constexpr auto binary_chunk_value(u64 chunk) -> u64 {
+	// Every byte is 0 or 1. The multiplication moves the bit of byte i to bit
+	// 63 - i, and no two partial products overlap.
+	return ((chunk - ones * '0') * 0x8040201008040201) >> 56;
+}
+
+static_assert(decimal_chunk_value(0x3837363534333231) == 12345678);
+static_assert(hex_chunk_value(0x3938376665444342) == 0xBCDEF789);
+static_assert(binary_chunk_value(0x3130303030303031) == 0b10000001);
+static_assert(binary_chunk_value(0x3031313131313130) == 0b01111110);
+
+struct Base {
+	// Digits needed to write the largest u64.
+	usz max_digits;
+	// radix^8, what the value so far is scaled by before adding a chunk.
+	u64 chunk_scale;
+	bool (*all_digits)(u64 chunk);
+	u64 (*chunk_value)(u64 chunk);
+};
+
+constexpr Base decimal = {20, 100'000'000, all_decimal_digits, decimal_chunk_value};
+constexpr Base hex = {16, u64(1) << 32, all_hex_digits, hex_chunk_value};
+constexpr Base binary = {64, u64(1) << 8, all_binary_digits, binary_chunk_value};
+
+} // namespace
+
+auto str_of_number_error(NumberError error) -> std::string {
+	switch (error) {
+		case NumberError::NoDigits: return "Missing digits";
+		case NumberError::InvalidDigit: return "Invalid digit";
+		case NumberError::Overflow: return "Value does not fit in 64 bits";
+	}
+	fiska_unreachable();
+}
+
+auto parse_number_literal(std::string_view literal) -> std::expected<u64, NumberError> {
+	const Base *base = &decimal;
+	if (literal.size() >= 2 and literal[0] == '0') {
+		if (literal[1] == 'x' or literal[1] == 'X') base = &hex;
+		if (literal[1] == 'b' or literal[1] == 'B') base = &binary;
+		if (base != &decimal) literal.remove_prefix(2);
+	}
+
+	// Leading zeros don't contribute to the value, but they still count as digits.
+	usz first_digit = literal.find_first_not_of("0_");
+	bool has_zero = literal.substr(0, first_digit).find('0') != std::string_view::npos;
+	std::string_view digits = first_digit == std::string_view::npos ? "" : literal.substr(first_digit);
+	if (digits.empty()) {
+		if (not has_zero) return std::unexpected(NumberError::NoDigits);
+		return 0;
+	}
+
+	// Line the digits up at the end of a buffer of whole chunks, leaving out the
+	// separators. The front is padded with zeros, which leave the value unchanged.
+	constexpr usz max_chunks = 8;
+	char buffer[max_chunks * 8];
+	usz num_digits = usz(std::ranges::count_if(digits, [](char c) { return c != '_'; }));
+	if (num_digits > base->max_digits) {
+		// Too long to be a valid number either way. Tell the two errors apart.
+		for (char c : digits) {
+			if (c == '_') continue;
+			char chunk[8] = {c, '0', '0', '0', '0', '0', '0', '0'};
+			if (not base->all_digits(load_chunk(chunk))) return std::unexpected(NumberError::InvalidDigit);
+		}
+		return std::unexpected(NumberError::Overflow);
+	}
+
+	usz num_chunks = (num_digits + 7) / 8;
+	char *padded = buffer + (max_chunks - num_chunks) * 8;
+	char *out = buffer + max_chunks * 8 - num_digits;
+	std::memset(padded, '0', usz(out - padded));
+	if (num_digits == digits.size()) {
+		std::memcpy(out, digits.data(), num_digits);
+	} else {
+		for (char c : digits) {
+			if (c != '_') *out++ = c;
+		}
+	}
+
+	u64 value = 0;
+	for (const char *chunk_ptr = padded; chunk_ptr < buffer + sizeof buffer; chunk_ptr += 8) {
+		u64 chunk = load_chunk(chunk_ptr);
+		if (not base->all_digits(chunk)) return std::unexpected(NumberError::InvalidDigit);
+
+		// Only decimal literals can overflow here, the other bases are caught by
+		// the digit count.
+		if (__builtin_mul_overflow(value, base->chunk_scale, &value)
+				or __builtin_add_overflow(value, base->chunk_value(chunk), &value)) {
+			return std::unexpected(NumberError::Overflow);
+		}
+	}
+	return value;
+}
+
+} // namespace lexer
+} // namespace fiskas
@@ -0,0 +1,33 @@
+#ifndef __FISKA_ASSEMBLER_FISKAS_NUMBER_LITERAL_HH__
+#define __FISKA_ASSEMBLER_FISKAS_NUMBER_LITERAL_HH__
+
+#include <expected>
+#include <string>
+#include <string_view>
+
+#include "base.hh"
+
+namespace fiskas {
+namespace lexer {
+
+enum struct NumberError {
+	// Nothing but a prefix and separators, e.g '0x' or '0b__'.
+	NoDigits,
+	// A char that is not a digit of the base, e.g '0b102' or '12ab'.
+	InvalidDigit,
+	// The value does not fit in 64 bits.
+	Overflow,
+};
+auto str_of_number_error(NumberError error) -> std::string;
+
+// Value of a number literal. Literals are either hexadecimal ('0x' or '0X'
+// prefix), binary ('0b' or '0B' prefix) or decimal, and digits can be grouped
+// with '_' separators, e.g '0x7fff_ffff', '0b1010' or '1_000_000'.
+//
+// Digits are converted 8 at a time within a u64 (SWAR) rather than one by one.
+auto parse_number_literal(std::string_view literal) -> std::expected<u64, NumberError>;
+
+} // namespace lexer
+} // namespace fiskas
+
+#endif // __FISKA_ASSEMBLER_FISKAS_NUMBER_LITERAL_HH__
@@ -1,8 +1,300 @@
+#include <limits>
+
 #include "base.hh"
 #include "parser.hh"
+#include "x86_instructions/mov/mov.hh"
+#include "x86_instructions/table_encoder.hh"
 
 namespace fiskas {
 namespace parser {
 
+namespace {
+
+using OperandParser = auto (Parser::*)() -> Expected<Operand>;
+
+// Parser of the operand starting with a given token, if there is one.
+constexpr auto operand_parsers = [] {
+	std::array<OperandParser, lexer::num_token_kinds> parsers{};
+	parsers[usz(+lexer::TokenKind::Identifier)] = &Parser::parse_reg_operand;
+	parsers[usz(+lexer::TokenKind::Number)] = &Parser::parse_imm_operand;
+	parsers[usz(+lexer::TokenKind::Minus)] = &Parser::parse_imm_operand;
+	parsers[usz(+lexer::TokenKind::LeftBracket)] = &Parser::parse_mem_operand;
+	return parsers;
+}();
+
+} // namespace
+
+auto str_of_operand_kind(OperandKind kind) -> std::string {
+	switch (kind) {
+		case OperandKind::Reg: return "Reg";
+		case OperandKind::Imm: return "Imm";
+		case OperandKind::Mem: return "Mem";
+	}
+	fiska_unreachable();
+}
+
+auto OperandList::form() const -> std::optional<Form> {
+	using enum OperandKind;
+
+	if (size == 0) return Form::NoOperands;
+	if (size != 2) return std::nullopt;
+	if (operands[0].kind == Reg and operands[1].kind == Reg) return Form::RegReg;
+	if (operands[0].kind == Reg and operands[1].kind == Mem) return Form::RegMem;
+	if (operands[0].kind == Mem and operands[1].kind == Reg) return Form::MemReg;
+	if (operands[0].kind == Reg and operands[1].kind == Imm) return Form::RegImm;
+	return std::nullopt;
+}
+
+auto Parser::parse_func_decl() -> Expected<FuncDecl *> {
+	using enum lexer::TokenKind;
+
+	auto func_decl = arena->make<FuncDecl>();
+	func_decl->span.offset = fiska_try(expect(Fn)).offset;
+	func_decl->name = arena->copy(literal(fiska_try(expect(Identifier))));
+
+	fiska_try(expect_all(LeftParen, RightParen));
+	lexer::Token left_brace = fiska_try(expect(LeftBrace));
+
+	body_scratch.clear();
+	while (true) {
+		const lexer::Token &tok = peek(0);
+		if (tok.kind == RightBrace) break;
+		if (tok.kind == Eof or tok.kind == Fn) {
+			// Not at |tok|, which usually has an error of its own already.
+			return std::unexpected(error(left_brace.offset, "Unclosed '{{' of function '{}'", func_decl->name));
+		}
+
+		usz statement_start = tok.offset;
+		auto instruction = [&] -> Expected<void> {
+			fiska_try(expect(Identifier));
+			return parse_instruction(last_consumed);
+		}();
+		if (not instruction) {
+			report(std::move(instruction.error()));
+			recover_statement(statement_start);
+		}
+	}
+	lexer::Token right_brace = next_token();
+	func_decl->body = body_scratch.freeze(*arena, func_decl->span.offset);
+
+	// The lexer may already be past the closing brace if someone looked ahead.
+	func_decl->span.len = right_brace.offset + right_brace.len - func_decl->span.offset;
+	return func_decl;
+}
+
+auto Parser::parse_instruction(lexer::Token mnemonic_tok) -> Expected<void> {
+	using enum common::X86Mnemonic;
+	using enum lexer::TokenKind;
+
+	auto mnemonic = common::x86_mnemonic_of_str(literal(mnemonic_tok));
+	if (not mnemonic) return std::unexpected(error(mnemonic_tok.offset, "Unrecognized mnemonic '{}'", literal(mnemonic_tok)));
+
+	switch (*mnemonic) {
+		case Mov:
+			return x86_instruction::MovInstructionParser::parse(this, mnemonic_tok);
+
+		case Ret: {
+			OperandList operands = fiska_try(parse_operand_list());
+			if (operands.size != 0) {
+				return std::unexpected(error(mnemonic_tok.offset, "ret takes no operands, found '{}'", operands.size));
+			}
+			emit(Ret, Form::NoOperands, mnemonic_tok.offset, operands);
+			return {};
+		}
+
+		default:
+			return x86_instruction::TableInstructionParser::parse(this, *mnemonic, mnemonic_tok);
+	}
+}
+
+auto Parser::parse_operand_list() -> Expected<OperandList> {
+	using enum lexer::TokenKind;
+
+	OperandList list;
+	fiska_try(expect(LeftParen));
+	if (peek(0).kind != RightParen) {
+		while (true) {
+			if (list.size == OperandList::max_operands) {
+				return std::unexpected(error(peek(0).offset, "More than '{}' operands", OperandList::max_operands));
+			}
+			list.operands[list.size++] = fiska_try(parse_operand());
+
+			if (peek(0).kind != Comma) break;
+			next_token();
+		}
+	}
+	fiska_try(expect_all(RightParen, SemiColon));
+	return list;
+}
+
+auto Parser::parse_operand() -> Expected<Operand> {
+	const lexer::Token &tok = peek(0);
+	OperandParser parse = operand_parsers[usz(+tok.kind)];
+	if (not parse) {
+		return std::unexpected(error(tok.offset, "Expected an operand but found '{}'", lexer::str_of_token_kind(tok.kind)));
+	}
+	return (this->*parse)();
+}
+
+auto Parser::parse_reg_operand() -> Expected<Operand> {
+	auto tok = fiska_try(expect(lexer::TokenKind::Identifier));
+	auto reg_name = common::reg_name_of_str(literal(tok));
+	if (not reg_name) return std::unexpected(error(tok.offset, "Unrecognized register name '{}'", literal(tok)));
+
+	return Operand{
+		.kind = OperandKind::Reg,
+		.tok = tok,
+		.reg = {.name = *reg_name, .width = common::bit_width_of_reg_name(*reg_name)},
+		.imm = 0,
+		.mem = {},
+	};
 }
+
+auto Parser::parse_imm_operand() -> Expected<Operand> {
+	lexer::Token first_tok = peek(0);
+	bool negative = first_tok.kind == lexer::TokenKind::Minus;
+	if (negative) next_token();
+
+	u64 value = fiska_try(expect(lexer::TokenKind::Number)).value;
+	if (negative and value > u64(1) << 63) {
+		return std::unexpected(error(first_tok.offset, "Immediate '-{}' does not fit in 64 bits", value));
+	}
+
+	// Negative values are kept in two's complement, it's up to the encoder to
+	// tell whether they fit in the immediate of the instruction.
+	return Operand{
+		.kind = OperandKind::Imm,
+		.tok = first_tok,
+		.reg = {},
+		.imm = negative ? ~value + 1 : value,
+		.mem = {},
+	};
+}
+
+auto Parser::parse_mem_operand() -> Expected<Operand> {
+	using enum lexer::TokenKind;
+
+	lexer::Token left_bracket = fiska_try(expect(LeftBracket));
+	common::MemRef mem;
+	i64 disp = 0;
+
+	bool negative = peek(0).kind == Minus;
+	if (negative) next_token();
+	while (true) {
+		const lexer::Token &tok = peek(0);
+
+		if (tok.kind == Number and peek(1).kind != Star) {
+			u64 value = next_token().value;
+			if (value > std::numeric_limits<u32>::max()) {
+				return std::unexpected(error(last_consumed.offset, "Displacement '{}' does not fit in 32 bits", value));
+			}
+			disp += negative ? -i64(value) : i64(value);
+
+		} else {
+			bool scaled = false;
+			u64 scale = 1;
+			if (tok.kind == Number) {
+				scale = next_token().value;
+				next_token();
+				scaled = true;
+			}
+
+			lexer::Token reg_tok = fiska_try(expect(Identifier));
+			auto reg_name = common::reg_name_of_str(literal(reg_tok));
+			if (not reg_name) return std::unexpected(error(reg_tok.offset, "Unrecognized register name '{}'", literal(reg_tok)));
+			if (negative) return std::unexpected(error(reg_tok.offset, "Registers can't be subtracted in an address"));
+
+			if (not scaled and peek(0).kind == Star) {
+				next_token();
+				scale = fiska_try(expect(Number)).value;
+				scaled = true;
+			}
+
+			auto mem_scale = common::scale_of_int(scale);
+			if (not mem_scale) return std::unexpected(error(reg_tok.offset, "Scale '{}' is not one of 1, 2, 4 or 8", scale));
+
+			if (not scaled and not mem.base) {
+				mem.base = *reg_name;
+			} else if (not mem.index) {
+				mem.index = *reg_name;
+				mem.scale = *mem_scale;
+			} else {
+				return std::unexpected(error(reg_tok.offset, "An address has at most a base and an index register"));
+			}
+		}
+
+		if (peek(0).kind == RightBracket) break;
+		if (peek(0).kind != Plus and peek(0).kind != Minus) {
+			return std::unexpected(unexpected_token(peek(0), RightBracket));
+		}
+		negative = next_token().kind == Minus;
+	}
+	next_token();
+
+	if (disp < std::numeric_limits<i32>::min() or disp > std::numeric_limits<i32>::max()) {
+		return std::unexpected(error(left_bracket.offset, "Displacement '{}' does not fit in 32 bits", disp));
+	}
+	mem.disp = i32(disp);
+
+	if (auto invalid = common::validate_mem_ref(mem)) return std::unexpected(error(left_bracket.offset, "{}", *invalid));
+	return Operand{.kind = OperandKind::Mem, .tok = left_bracket, .reg = {}, .imm = 0, .mem = mem};
+}
+
+auto Parser::emit(common::X86Mnemonic mnemonic, Form form, usz source_offset, const OperandList &operands)
+	-> void
+{
+	body_scratch.push(mnemonic, form, source_offset);
+	for (usz i = 0; i < operands.size; ++i) {
+		switch (operands[i].kind) {
+			case OperandKind::Reg:
+				body_scratch.push_reg(operands[i].reg.name);
+				break;
+
+			case OperandKind::Mem:
+				body_scratch.push_mem(operands[i].mem);
+				break;
+
+			case OperandKind::Imm:
+				body_scratch.push_imm(operands[i].imm);
+				break;
+		}
+	}
+}
+
+auto Parser::recover_statement(usz statement_start) -> void {
+	using enum lexer::TokenKind;
+
+	if (last_consumed.kind == SemiColon and last_consumed.offset >= statement_start) return;
+	for (auto kind = peek(0).kind; kind != SemiColon; kind = peek(0).kind) {
+		if (kind == RightBrace or kind == Fn or kind == Eof) return;
+		next_token();
+	}
+	next_token();
 }
+
+auto Parser::parse_program() -> std::vector<FuncDecl *> {
+	using enum lexer::TokenKind;
+
+	std::vector<FuncDecl *> func_decls;
+	while (peek(0).kind != Eof) {
+		auto func_decl = parse_func_decl();
+		if (func_decl) {
+			func_decls.push_back(*func_decl);
+			continue;
+		}
+
+		report(std::move(func_decl.error()));
+		// A failed declaration always consumes its 'fn', so this can't get stuck.
+		while (peek(0).kind != Fn and peek(0).kind != Eof) next_token();
+	}
+	return func_decls;
+}
+
+auto parse_module(std::string_view source) -> Module {
+	Module module;
+	module.func_decls = Parser{source, &module.arena}.parse_program();
+	return module;
+}
+
+} // namespace parser
+} // namespace fiskas
@@ -1,6 +1,14 @@
 #ifndef __FISKA_ASSEMBLER_FISKAS_PARSER_HH__
 #define __FISKA_ASSEMBLER_FISKAS_PARSER_HH__
 
+#include <array>
+#include <optional>
+#include <span>
+#include <vector>
+
+#include "arena.hh"
+#include "diagnostics.hh"
+#include "instruction_stream.hh"
 #include "lexer.hh"
 #include "base.hh"
 #include "x86_common.hh"
@@ -8,39 +16,149 @@
 namespace fiskas {
 namespace parser {
 
-struct Instruction {
-	common::X86Mnemonic mnemonic;
+// Everything a declaration points to lives in the arena it was parsed into,
+// including its name, so it outlives the source.
+struct FuncDecl {
+	std::string_view name;
+	InstructionStream body;
+	// Where the declaration sits in the source, from the 'fn' keyword up to
+	// and including the closing brace.
+	lexer::SourceSpan span{};
+};
+
+// A parsed source file. The declarations and their instructions are all
+// allocated in |arena|, and are freed in one go with the module.
+struct Module {
+	Arena arena;
+	std::vector<FuncDecl *> func_decls;
+	// Bytes an edit left with errors, see |reparse|. The declarations in it
+	// are the ones from before that edit.
+	std::optional<lexer::SourceSpan> damaged;
+};
 
-	auto encode() -> std::vector<u8>;
+enum struct OperandKind : u8 {
+	Reg,
+	Imm,
+	Mem,
 };
+auto str_of_operand_kind(OperandKind kind) -> std::string;
 
-struct FuncDecl {
-	std::string name;
-	std::vector<Instruction> body;
+struct Operand {
+	OperandKind kind{};
+	// First token of the operand, for diagnostics.
+	lexer::Token tok{};
+	common::Reg reg{};
+	u64 imm{};
+	common::MemRef mem{};
+};
+
+// The operands of an instruction, between its parentheses. Fixed size so that
+// parsing an instruction never allocates.
+struct OperandList {
+	constexpr static usz max_operands = 4;
+
+	std::array<Operand, max_operands> operands{};
+	usz size{};
+
+public:
+	auto operator[](usz idx) const -> const Operand & { return operands[idx]; }
+	// The form matching the kinds of the operands, if there is one.
+	auto form() const -> std::optional<Form>;
 };
 
 struct Parser : lexer::Lexer {
-	Parser(std::string source) : Lexer(source) {}
+	// Number of tokens the parser can look ahead of the next one.
+	constexpr static usz lookahead = 4;
 
-	auto parse_func_decl() -> FuncDecl;
+	// Where the declarations and instructions are allocated. Not owned.
+	Arena *arena;
+	// Instructions of the declaration being parsed, reused from one declaration to the next.
+	InstructionStreamBuilder body_scratch;
 
+	// Tokens already lexed but not consumed yet. They are never lexed twice.
+	std::array<lexer::Token, lookahead> ring{};
+	usz ring_head{};
+	usz ring_size{};
+	// Tells error recovery whether the statement that failed was consumed up
+	// to its ';' already.
+	lexer::Token last_consumed{};
 
 public:
-	template <typename... TokenKinds>
-	auto consume_pnc(const TokenKinds&... tok_kinds) -> void {
-		auto check_if_tok_kind_matches = [this](const lexer::TokenKind &tok_kind) {
-			fiska_assert(next_token().kind == tok_kind);
-		};
+	// Errors are reported to |diagnostics_| if there is one, and the parser
+	// recovers from them. Otherwise the first error ends the process.
+	Parser(std::string_view source, Arena *arena_, usz start_offset = 0, Diagnostics *diagnostics_ = nullptr)
+		: Lexer(source, start_offset), arena(arena_)
+	{
+		diagnostics = diagnostics_;
+	}
+
+	// Hides the one of |Lexer| so that every token goes through the ring.
+	auto next_token() -> lexer::Token {
+		lexer::Token tok = peek(0);
+		ring_head = (ring_head + 1) % lookahead;
+		ring_size--;
+		last_consumed = tok;
+		return tok;
+	}
+
+	// The token |k| tokens after the next one, without consuming anything.
+	auto peek(usz k) -> const lexer::Token & {
+		fiska_assert(k < lookahead, "Can't look '{}' tokens ahead, the limit is '{}'", k, lookahead - 1);
+		for (; ring_size <= k; ++ring_size) ring[(ring_head + ring_size) % lookahead] = Lexer::next_token();
+		return ring[(ring_head + k) % lookahead];
+	}
+
+	// Errors in the body are reported and skipped one statement at a time, the
+	// ones in the signature or a missing '}' make the whole declaration fail.
+	auto parse_func_decl() -> Expected<FuncDecl *>;
+	// Parse an instruction and append it to |body_scratch|.
+	auto parse_instruction(lexer::Token mnemonic_tok) -> Expected<void>;
+	// Parse function declarations until the end of the source. A declaration
+	// that fails is reported and skipped up to the next 'fn'.
+	auto parse_program() -> std::vector<FuncDecl *>;
 
-		(check_if_tok_kind_matches(tok_kinds) , ...);
+	// '(' [operand {',' operand}] ')' ';'
+	auto parse_operand_list() -> Expected<OperandList>;
+	// The kind of operand is picked from its first token, see |operand_parsers|.
+	auto parse_operand() -> Expected<Operand>;
+	auto parse_reg_operand() -> Expected<Operand>;
+	// ['-'] number
+	auto parse_imm_operand() -> Expected<Operand>;
+	// '[' ['-'] term {('+' | '-') term} ']' where a term is a register, a scaled
+	// register (reg '*' scale or scale '*' reg) or a displacement.
+	auto parse_mem_operand() -> Expected<Operand>;
+	// Append an instruction with its operands to |body_scratch|.
+	auto emit(common::X86Mnemonic mnemonic, Form form, usz source_offset, const OperandList &operands) -> void;
+
+	// Skip the rest of the statement starting at |statement_start| that just
+	// failed, up to and including its ';'.
+	auto recover_statement(usz statement_start) -> void;
+
+public:
+	// Consume the next token if it is a |tok_kind|. Otherwise it is left for
+	// error recovery to resume from.
+	auto expect(lexer::TokenKind tok_kind) -> Expected<lexer::Token> {
+		if (peek(0).kind != tok_kind) return std::unexpected(unexpected_token(peek(0), tok_kind));
+		return next_token();
 	}
 
+	// Stops at the first token that doesn't match.
 	template <typename... TokenKinds>
-	auto consume(const TokenKinds&... tok_kind) -> bool {
-		return ((next_token().kind == tok_kind) and ...);
+	auto expect_all(const TokenKinds&... tok_kinds) -> Expected<void> {
+		Expected<lexer::Token> tok;
+		((tok = expect(tok_kinds)) and ...);
+		if (not tok) return std::unexpected(std::move(tok.error()));
+		return {};
+	}
+
+	auto unexpected_token(const lexer::Token &tok, lexer::TokenKind expected) -> Diagnostic {
+		return error(tok.offset, "Expected token '{}' but found '{}'",
+				lexer::str_of_token_kind(expected), lexer::str_of_token_kind(tok.kind));
 	}
 };
 
+auto parse_module(std::string_view source) -> Module;
+
 } // namespace parser
 } // namespace fiskas 
 
@@ -2,6 +2,7 @@
 
 #include "base.hh"
 #include "parser.hh"
+#include "splitter.hh"
 
 namespace fiskas {
 namespace parser {
@@ -13,6 +14,350 @@ TEST(SmokeTest, SmokeTest_1) {
 	EXPECT_EQ(1, 1);
 }
 
+TEST(Parser, ParseFuncDecl) {
+	std::string program = R"(
+	fn start() {
+		mov(rax, rbx);
+		mov(r8, r9);
+		ret();
+	}
+	)";
 
+	Arena arena;
+	Parser parser{program, &arena};
+	FuncDecl *func_decl = parser.parse_func_decl().value();
+
+	EXPECT_EQ(func_decl->name, "start");
+	ASSERT_EQ(func_decl->body.size(), 3u);
+	EXPECT_EQ(func_decl->body.mnemonic(0), common::X86Mnemonic::Mov);
+	EXPECT_EQ(func_decl->body.mnemonic(2), common::X86Mnemonic::Ret);
+	EXPECT_EQ(program.substr(func_decl->span.offset, 2), "fn");
+	EXPECT_EQ(program[func_decl->span.end() - 1], '}');
+	EXPECT_EQ(parser.next_token().kind, TokenKind::Eof);
+}
+
+TEST(Parser, ParseProgram) {
+	std::string program = "fn a() { ret(); } fn b() { mov(rax, rcx); ret(); } fn c() {}";
+
+	Module module = parse_module(program);
+	auto &func_decls = module.func_decls;
+	ASSERT_EQ(func_decls.size(), 3u);
+	EXPECT_EQ(func_decls[0]->name, "a");
+	EXPECT_EQ(func_decls[1]->name, "b");
+	EXPECT_EQ(func_decls[1]->body.size(), 2u);
+	EXPECT_EQ(func_decls[2]->name, "c");
+	EXPECT_TRUE(func_decls[2]->body.empty());
+}
+
+TEST(Parser, ModuleOwnsEverything) {
+	std::string program = "fn first() { mov(rax, rcx); ret(); } fn second() { ret(); }";
+	Module module = parse_module(program);
+
+	// Nothing points into the source anymore.
+	program.assign(program.size(), '#');
+	EXPECT_EQ(module.func_decls[0]->name, "first");
+	EXPECT_EQ(module.func_decls[1]->name, "second");
+
+	// Moving the module keeps the declarations where they are.
+	FuncDecl *first = module.func_decls[0];
+	Module moved = std::move(module);
+	EXPECT_EQ(moved.func_decls[0], first);
+	EXPECT_EQ(first->body.mnemonic(1), common::X86Mnemonic::Ret);
+	EXPECT_GT(moved.arena.bytes_used, 0u);
+	EXPECT_EQ(moved.arena.blocks.size(), 1u);
+}
+
+TEST(Parser, PeekDoesNotConsume) {
+	std::string program = "fn f() { ret(); }";
+	Arena arena;
+	Parser parser{program, &arena};
+
+	EXPECT_EQ(parser.peek(3).kind, TokenKind::RightParen);
+	EXPECT_EQ(parser.peek(0).kind, TokenKind::Fn);
+	EXPECT_EQ(parser.peek(1).kind, TokenKind::Identifier);
+	EXPECT_EQ(parser.literal(parser.peek(1)), "f");
+
+	// Peeking lexed 4 tokens, which are handed out without lexing them again.
+	usz lexed_up_to = parser.pos();
+	EXPECT_EQ(parser.next_token().kind, TokenKind::Fn);
+	EXPECT_EQ(parser.next_token().kind, TokenKind::Identifier);
+	EXPECT_EQ(parser.pos(), lexed_up_to);
+
+	// The ring wraps around.
+	EXPECT_EQ(parser.peek(3).kind, TokenKind::Identifier);
+	EXPECT_EQ(parser.literal(parser.peek(3)), "ret");
+	for (auto kind : {TokenKind::LeftParen, TokenKind::RightParen, TokenKind::LeftBrace, TokenKind::Identifier,
+			TokenKind::LeftParen, TokenKind::RightParen, TokenKind::SemiColon, TokenKind::RightBrace,
+			TokenKind::Eof, TokenKind::Eof}) {
+		EXPECT_EQ(parser.next_token().kind, kind);
+	}
+}
+
+TEST(Parser, SpanEndsAtTheClosingBraceWhenLookingAhead) {
+	std::string program = "fn f() { ret(); } fn g() {}";
+	Arena arena;
+	Parser parser{program, &arena};
+
+	FuncDecl *f = parser.parse_func_decl().value();
+	EXPECT_EQ(parser.peek(2).kind, TokenKind::LeftParen);
+	EXPECT_EQ(program.substr(f->span.offset, f->span.len), "fn f() { ret(); }");
+}
+
+TEST(Parser, OperandDispatch) {
+	std::string program = "(rax, 0x10, r9);";
+	Arena arena;
+	Parser parser{program, &arena};
+
+	OperandList operands = parser.parse_operand_list().value();
+	ASSERT_EQ(operands.size, 3u);
+	EXPECT_EQ(operands[0].kind, OperandKind::Reg);
+	EXPECT_EQ(operands[0].reg.name, common::RegName::Rax);
+	EXPECT_EQ(operands[1].kind, OperandKind::Imm);
+	EXPECT_EQ(operands[1].imm, 0x10u);
+	EXPECT_EQ(operands[2].kind, OperandKind::Reg);
+	EXPECT_EQ(operands[2].reg.name, common::RegName::R9);
+	EXPECT_EQ(operands.form(), std::nullopt);
+	EXPECT_EQ(parser.next_token().kind, TokenKind::Eof);
+}
+
+TEST(Parser, FormOfOperandList) {
+	Arena arena;
+	auto form_of = [&](std::string_view operands) {
+		Parser parser{operands, &arena};
+		return parser.parse_operand_list().value().form();
+	};
+
+	EXPECT_EQ(form_of("();"), Form::NoOperands);
+	EXPECT_EQ(form_of("(rax, rbx);"), Form::RegReg);
+	EXPECT_EQ(form_of("(rax);"), std::nullopt);
+	EXPECT_EQ(form_of("(rax, 1);"), Form::RegImm);
+	EXPECT_EQ(form_of("(rax, -1);"), Form::RegImm);
+	EXPECT_EQ(form_of("(1, rax);"), std::nullopt);
+	EXPECT_EQ(form_of("(rax, [rbx]);"), Form::RegMem);
+	EXPECT_EQ(form_of("([rbx], rax);"), Form::MemReg);
+}
+
+TEST(InstructionStream, RecordsFormsOperandsAndOffsets) {
+	std::string program = "fn e() {}\nfn f() { mov(rax, r9); ret(); mov(r15, rbx); }";
+	Module module = parse_module(program);
+	const InstructionStream &body = module.func_decls[1]->body;
+	usz f_offset = program.find("fn f");
+
+	ASSERT_EQ(body.size(), 3u);
+	EXPECT_EQ(body.form(0), Form::RegReg);
+	EXPECT_EQ(body.form(1), Form::NoOperands);
+	EXPECT_EQ(body.form(2), Form::RegReg);
+	// Relative to the declaration.
+	EXPECT_EQ(body.source_offset(0), program.find("mov") - f_offset);
+	EXPECT_EQ(body.source_offset(1), program.find("ret") - f_offset);
+	EXPECT_EQ(body.source_offset(2), program.rfind("mov") - f_offset);
+
+	auto operands = body.operand_reader(2);
+	EXPECT_EQ(operands.reg(), common::RegName::R15);
+	EXPECT_EQ(operands.reg(), common::RegName::Rbx);
+
+	EXPECT_EQ(encode_instruction(body, 1), common::InstructionBytes{0xc3});
+}
+
+TEST(InstructionStream, UsesLessThan16BytesPerInstruction) {
+	std::string program = "fn big() {\n";
+	for (usz i = 0; i < 10000; ++i) program += i % 4 == 3 ? "\tret();\n" : "\tmov(r12, rax);\n";
+	program += "}\n";
+
+	Module module = parse_module(program);
+	const InstructionStream &body = module.func_decls[0]->body;
+	ASSERT_EQ(body.size(), 10000u);
+	EXPECT_LT(body.size_in_bytes(), 16 * body.size());
+	EXPECT_LT(module.arena.bytes_used, 16 * body.size());
+}
+
+TEST(InstructionStream, EveryFormTakesLessThan16Bytes) {
+	std::pair<std::string_view, f64> cases[] = {
+		{"ret();", 6.5},
+		{"mov(r12, rax);", 8.5},
+		{"mov(rax, [rbx + 8*rcx - 16]);", 14.5},
+		{"mov([rbx + 8], rax);", 14.5},
+		{"mov(rax, 0x1234_5678_9abc);", 15.5},
+	};
+
+	for (const auto &[instruction, bytes_per_instruction] : cases) {
+		std::string program = "fn f() {\n";
+		for (usz i = 0; i < 800; ++i) program += fmt::format("\t{}\n", instruction);
+		program += "}\n";
+
+		Module module = parse_module(program);
+		const InstructionStream &body = module.func_decls[0]->body;
+		EXPECT_EQ(f64(body.size_in_bytes()) / f64(body.size()), bytes_per_instruction) << instruction;
+	}
+}
+
+TEST(InstructionStream, OperandsAreFoundFromTheForms) {
+	// Every form, in an order that doesn't line up with the checkpoints.
+	std::string_view instructions[] = {
+		"mov(rax, rbx);", "ret();", "mov(rcx, [rdx + 4]);", "mov([r8], r9);", "mov(r10, 7);", "add(rsi, rdi);",
+	};
+	std::string program = "fn f() {\n";
+	for (usz i = 0; i < 50; ++i) program += fmt::format("\t{}\n", instructions[i % std::size(instructions)]);
+	program += "}\n";
+
+	Module module = parse_module(program);
+	const InstructionStream &body = module.func_decls[0]->body;
+	usz offset = 0;
+	for (usz idx = 0; idx < body.size(); ++idx) {
+		EXPECT_EQ(body.operand_offset(idx), offset) << idx;
+		offset += operand_size_of_form[usz(body.form(idx))];
+	}
+	EXPECT_EQ(offset, body.operands.size());
+	EXPECT_EQ(body.operand_reader(46).reg(), common::RegName::R10);
+	EXPECT_EQ(body.operand_reader(47).reg(), common::RegName::Rsi);
+}
+
+TEST(Arena, AlignsAndBumps) {
+	Arena arena(256);
+	auto *byte = arena.make<u8>(u8(1));
+	auto *word = arena.make<u64>(u64(2));
+	EXPECT_EQ(*byte, 1);
+	EXPECT_EQ(*word, 2u);
+	EXPECT_EQ(uptr(word) % alignof(u64), 0u);
+	EXPECT_EQ(reinterpret_cast<std::byte *>(word) - reinterpret_cast<std::byte *>(byte), 8);
+
+	// Allocations too big for a regular block don't waste the current one.
+	auto big = arena.copy(std::span<const u8>(std::vector<u8>(1000, 7)));
+	EXPECT_EQ(big.size(), 1000u);
+	EXPECT_EQ(big[999], 7);
+	auto *next = arena.make<u64>(u64(3));
+	EXPECT_EQ(reinterpret_cast<std::byte *>(next) - reinterpret_cast<std::byte *>(word), 8);
+	EXPECT_EQ(arena.blocks.size(), 2u);
+
+	for (usz i = 0; i < 100; ++i) EXPECT_EQ(*arena.make<u64>(i), i);
+	EXPECT_EQ(arena.blocks.size(), 5u);
+}
+
+TEST(Arena, RunsDestructorsInReverseOrder) {
+	std::vector<i32> destroyed;
+	struct Tracked {
+		std::vector<i32> *destroyed;
+		i32 id;
+		~Tracked() { destroyed->push_back(id); }
+	};
+
+	{
+		Arena arena;
+		arena.make<Tracked>(&destroyed, 1);
+		arena.make<Tracked>(&destroyed, 2);
+		Arena moved = std::move(arena);
+		EXPECT_TRUE(destroyed.empty());
+	}
+	EXPECT_EQ(destroyed, (std::vector<i32>{2, 1}));
 }
+
+TEST(Parser, MemoryOperands) {
+	using enum common::RegName;
+	using Scale = common::MemRef::Scale;
+
+	std::string program = "fn f() { mov([r8 + 4*rcx - 0x10 + 4], rax); mov(rdx, [-8]); }";
+	Arena arena;
+	Parser parser{program, &arena};
+	FuncDecl *f = parser.parse_func_decl().value();
+
+	ASSERT_EQ(f->body.size(), 2u);
+	EXPECT_EQ(f->body.form(0), Form::MemReg);
+	EXPECT_EQ(f->body.form(1), Form::RegMem);
+
+	OperandReader store = f->body.operand_reader(0);
+	EXPECT_EQ(store.mem(), (common::MemRef{.base = R8, .index = Rcx, .scale = Scale::Four, .disp = -12}));
+	EXPECT_EQ(store.reg(), Rax);
+
+	OperandReader load = f->body.operand_reader(1);
+	EXPECT_EQ(load.reg(), Rdx);
+	EXPECT_EQ(load.mem(), (common::MemRef{.base = std::nullopt, .index = std::nullopt, .scale = Scale::One, .disp = -8}));
 }
+
+TEST(Parser, RecoversFromErrors) {
+	std::string program =
+		"fn a() {\n"
+		"\tmov(rax rbx);\n"
+		"\tpush(rax);\n"
+		"\tret();\n"
+		"}\n"
+		"fn b( {\n"
+		"\tret();\n"
+		"}\n"
+		"fn c() {\n"
+		"\tmov(rax, 0x);\n"
+		"\tmov(rax, rbx);\n"
+		"}\n";
+
+	Arena arena;
+	Diagnostics diagnostics;
+	Parser parser{program, &arena, 0, &diagnostics};
+	std::vector<FuncDecl *> func_decls = parser.parse_program();
+
+	// The declarations with errors in their body are still there, without the
+	// instructions that failed.
+	ASSERT_EQ(func_decls.size(), 2u);
+	EXPECT_EQ(func_decls[0]->name, "a");
+	EXPECT_EQ(func_decls[0]->body.size(), 1u);
+	EXPECT_EQ(func_decls[1]->name, "c");
+	EXPECT_EQ(func_decls[1]->body.size(), 1u);
+
+	// The bad number literal is reported by the lexer only.
+	ASSERT_EQ(diagnostics.size(), 4u);
+	EXPECT_EQ(diagnostics.errors[0].str(), "2:10: error: Expected token '<RightParen>' but found '<Identifier>'");
+	EXPECT_EQ(diagnostics.errors[1].str(), "3:2: error: Unrecognized mnemonic 'push'");
+	EXPECT_EQ(diagnostics.errors[2].str(), "6:7: error: Expected token '<RightParen>' but found '<LeftBrace>'");
+	EXPECT_EQ(diagnostics.errors[3].location.line, 10u);
+	EXPECT_EQ(diagnostics.errors[3].location.col, 11u);
+}
+
+TEST(Parser, MissingClosingBrace) {
+	std::string program = "fn a() {\n\tret();\n\tret(\nfn b() { ret(); }";
+
+	Arena arena;
+	Diagnostics diagnostics;
+	std::vector<FuncDecl *> func_decls = Parser{program, &arena, 0, &diagnostics}.parse_program();
+
+	ASSERT_EQ(func_decls.size(), 1u);
+	EXPECT_EQ(func_decls[0]->name, "b");
+	ASSERT_EQ(diagnostics.size(), 2u);
+	EXPECT_EQ(diagnostics.errors[0].location.line, 4u);
+	EXPECT_EQ(diagnostics.errors[1].str(), "1:8: error: Unclosed '{' of function 'a'");
+}
+
+TEST(Splitter, SplitsAtTopLevelBraces) {
+	std::string program = "fn a() { ret(); }\nfn b() { mov(rax, rcx); }\n\n";
+
+	auto spans = split_top_level_fns(program);
+	ASSERT_EQ(spans.size(), 2u);
+	EXPECT_EQ(spans[0].offset, 0u);
+	EXPECT_EQ(program.substr(spans[0].offset, spans[0].len), "fn a() { ret(); }");
+	EXPECT_EQ(program.substr(spans[1].offset, spans[1].len), "\nfn b() { mov(rax, rcx); }\n\n");
+}
+
+TEST(Splitter, IgnoresBracesInComments) {
+	std::string program =
+		"// fn commented_out() {\n"
+		"fn a() { /* } { */ ret(); } // }\n"
+		"/* fn b() { */ fn c() { { } }";
+
+	auto spans = split_top_level_fns(program);
+	ASSERT_EQ(spans.size(), 2u);
+	EXPECT_EQ(program[spans[0].end() - 1], '}');
+	EXPECT_EQ(program.substr(spans[0].end() - 9, 9), " ret(); }");
+	EXPECT_EQ(spans[1].end(), program.size());
+}
+
+TEST(Splitter, EmptySource) {
+	EXPECT_TRUE(split_top_level_fns("").empty());
+}
+
+TEST(Splitter, UnbalancedBraces) {
+	std::string program = "fn a() { ret(); }\n}";
+
+	auto spans = try_split_top_level_fns(program, scan::StructuralIndex::build(program));
+	ASSERT_FALSE(spans.has_value());
+	EXPECT_EQ(spans.error().str(), "2:1: error: Unbalanced '}'");
+}
+
+} // namespace parser
+} // namespace fiskas
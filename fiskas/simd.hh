@@ -0,0 +1,84 @@
+#ifndef __FISKA_ASSEMBLER_FISKAS_SIMD_HH__
+#define __FISKA_ASSEMBLER_FISKAS_SIMD_HH__
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define FISKA_SIMD_X86 1
+#else
+#define FISKA_SIMD_X86 0
+#endif
+
+#include "base.hh"
+
+// Thin wrappers over the SSE2 and AVX2 intrinsics shared by the scanners. Only
+// include this from translation units that pick the ISA at runtime, see
+// |scan::active_isa|.
+#if FISKA_SIMD_X86
+namespace fiskas {
+namespace simd {
+
+// Every class is built out of byte equalities and inclusive byte ranges.
+// A range check [lo, hi] is done with a single unsigned comparison:
+// (u8)(c - lo) <= (hi - lo), which is expressed as min(c - lo, hi - lo) == c - lo
+// since SSE2 has no unsigned byte compare.
+//
+// The class functions are spelled out in each ISA struct so that they carry the
+// same target attribute as the intrinsics they inline. GCC refuses to inline a
+// target specific function into one compiled for a smaller ISA, which rules out
+// writing them once as templates.
+#define FISKA_DEFINE_CHAR_CLASSES(target)                                                  \
+	target static auto whitespace(Vec v) -> Vec {                                            \
+		return or_(or_(eq(v, ' '), eq(v, '\n')), or_(eq(v, '\t'), eq(v, '\r')));           \
+	}                                                                                        \
+	target static auto number(Vec v) -> Vec { return in_range(v, '0', '9'); }               \
+	target static auto ident_continue(Vec v) -> Vec {                                        \
+		/* Setting bit 5 maps 'A'-'Z' onto 'a'-'z' and leaves 'a'-'z' alone. */             \
+		Vec letters = in_range(or_(v, splat(0x20)), 'a', 'z');                               \
+		return or_(or_(letters, number(v)), eq(v, '_'));                                     \
+	}
+
+struct Sse2 {
+	using Vec = __m128i;
+	constexpr static usz width = 16;
+	constexpr static u32 all_set = 0xffff;
+
+	static auto load(const char *p) -> Vec { return _mm_loadu_si128(reinterpret_cast<const Vec *>(p)); }
+	static auto splat(char c) -> Vec { return _mm_set1_epi8(c); }
+	static auto eq(Vec a, char c) -> Vec { return _mm_cmpeq_epi8(a, splat(c)); }
+	static auto or_(Vec a, Vec b) -> Vec { return _mm_or_si128(a, b); }
+	static auto in_range(Vec a, char lo, char hi) -> Vec {
+		Vec shifted = _mm_sub_epi8(a, splat(lo));
+		return _mm_cmpeq_epi8(_mm_min_epu8(shifted, splat(char(hi - lo))), shifted);
+	}
+	static auto mask(Vec a) -> u32 { return u32(_mm_movemask_epi8(a)); }
+
+	FISKA_DEFINE_CHAR_CLASSES()
+};
+
+struct Avx2 {
+	using Vec = __m256i;
+	constexpr static usz width = 32;
+	constexpr static u32 all_set = 0xffffffff;
+
+	[[gnu::target("avx2")]] static auto load(const char *p) -> Vec {
+		return _mm256_loadu_si256(reinterpret_cast<const Vec *>(p));
+	}
+	[[gnu::target("avx2")]] static auto splat(char c) -> Vec { return _mm256_set1_epi8(c); }
+	[[gnu::target("avx2")]] static auto eq(Vec a, char c) -> Vec { return _mm256_cmpeq_epi8(a, splat(c)); }
+	[[gnu::target("avx2")]] static auto or_(Vec a, Vec b) -> Vec { return _mm256_or_si256(a, b); }
+	[[gnu::target("avx2")]] static auto in_range(Vec a, char lo, char hi) -> Vec {
+		Vec shifted = _mm256_sub_epi8(a, splat(lo));
+		return _mm256_cmpeq_epi8(_mm256_min_epu8(shifted, splat(char(hi - lo))), shifted);
+	}
+	[[gnu::target("avx2")]] static auto mask(Vec a) -> u32 { return u32(_mm256_movemask_epi8(a)); }
+
+	FISKA_DEFINE_CHAR_CLASSES([[gnu::target("avx2")]])
+};
+
+#undef FISKA_DEFINE_CHAR_CLASSES
+
+} // namespace simd
+} // namespace fiskas
+#endif // FISKA_SIMD_X86
+
+#endif // __FISKA_ASSEMBLER_FISKAS_SIMD_HH__
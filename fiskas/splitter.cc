@@ -0,0 +1,90 @@
+#include "base.hh"
+#include "splitter.hh"
+
+namespace fiskas {
+namespace parser {
+
+auto split_top_level_fns(std::string_view source) -> std::vector<lexer::SourceSpan> {
+	return split_top_level_fns(source, scan::StructuralIndex::build(source));
+}
+
+namespace {
+
+// Only called on a broken source, so the line table isn't worth keeping around.
+auto error_at(std::string_view source, usz offset, std::string message) -> Diagnostic {
+	return {
+		.offset = offset,
+		.location = lexer::LineTable::build(source).location_of(offset),
+		.message = std::move(message),
+	};
+}
+
+} // namespace
+
+auto split_top_level_fns(std::string_view source, const scan::StructuralIndex &index)
+	-> std::vector<lexer::SourceSpan>
+{
+	auto spans = try_split_top_level_fns(source, index);
+	fiska_assert(spans.has_value(), "{}", spans.error().str());
+	return std::move(*spans);
+}
+
+auto try_split_top_level_fns(std::string_view source, const scan::StructuralIndex &index)
+	-> Expected<std::vector<lexer::SourceSpan>>
+{
+	std::vector<lexer::SourceSpan> spans;
+	usz span_start = 0;
+	usz depth = 0;
+
+	// Hop from brace to brace. The next comment start is
+	// cached since comments are rare and looking it up again after every
+	// brace would rescan the same words over and over.
+	usz pos = 0;
+	usz next_comment = index.next_comment_start(0);
+	while (true) {
+		if (next_comment < pos) next_comment = index.next_comment_start(pos);
+		usz i = std::min(index.next_brace(pos), next_comment);
+		if (i >= source.size()) break;
+
+		if (i == next_comment) {
+			if (source[i + 1] == '/') {
+				pos = index.next_newline(i + 2);
+				continue;
+			}
+
+			usz comment_end = source.find("*/", i + 2);
+			if (comment_end == std::string_view::npos) {
+				return std::unexpected(error_at(source, i, "Unterminated block comment"));
+			}
+			pos = comment_end + 2;
+			continue;
+		}
+
+		if (source[i] == '{') {
+			depth++;
+
+		} else if (source[i] == '}') {
+			if (depth == 0) return std::unexpected(error_at(source, i, "Unbalanced '}'"));
+			if (--depth == 0) {
+				spans.push_back({.offset = span_start, .len = i + 1 - span_start});
+				span_start = i + 1;
+			}
+		}
+		pos = i + 1;
+	}
+	if (depth != 0) {
+		return std::unexpected(error_at(source, source.size(),
+				fmt::format("Reached the end of the source with '{}' unclosed '{{'", depth)));
+	}
+
+	if (spans.empty()) {
+		if (not source.empty()) spans.push_back({.offset = 0, .len = source.size()});
+		return spans;
+	}
+
+	spans.back().len = source.size() - spans.back().offset;
+	return spans;
+}
+
+} // namespace parser
+} // namespace fiskas
@@ -0,0 +1,33 @@
+#ifndef __FISKA_ASSEMBLER_FISKAS_SPLITTER_HH__
+#define __FISKA_ASSEMBLER_FISKAS_SPLITTER_HH__
+
+#include <vector>
+
+#include "base.hh"
+#include "diagnostics.hh"
+#include "lexer.hh"
+#include "structural_index.hh"
+
+namespace fiskas {
+namespace parser {
+
+// Cut the source into one span per top-level function declaration without
+// lexing it, using a |StructuralIndex| to jump straight from brace to brace.
+// Every span starts where the previous one ended and runs up to and including
+// the brace closing the function body; the text that follows the last function
+// goes with it. Braces inside comments are ignored.
+//
+// The spans cover the whole source and can be parsed independently of each other.
+auto split_top_level_fns(std::string_view source) -> std::vector<lexer::SourceSpan>;
+// Same as above, reusing an index already built for |source|.
+auto split_top_level_fns(std::string_view source, const scan::StructuralIndex &index)
+	-> std::vector<lexer::SourceSpan>;
+// Same as above, with an error instead of exiting when the braces or the block
+// comments of |source| aren't balanced.
+auto try_split_top_level_fns(std::string_view source, const scan::StructuralIndex &index)
+	-> Expected<std::vector<lexer::SourceSpan>>;
+
+} // namespace parser
+} // namespace fiskas
+
+#endif // __FISKA_ASSEMBLER_FISKAS_SPLITTER_HH__
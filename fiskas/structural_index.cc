@@ -0,0 +1,142 @@
+#include "base.hh"
+#include "char_scan.hh"
+#include "simd.hh"
+#include "structural_index.hh"
+
+namespace fiskas {
+namespace scan {
+
+namespace {
+
+// Bitmaps of one 64 byte block.
+struct BlockMasks {
+	u64 structural{};
+	u64 braces{};
+	u64 newlines{};
+	u64 slashes{};
+	u64 stars{};
+};
+
+auto scalar_classify(const char *p) -> BlockMasks {
+	BlockMasks masks;
+	for (usz i = 0; i < 64; ++i) {
+		u64 bit = u64(1) << i;
+		switch (p[i]) {
+			case '{':
+			case '}':
+				masks.braces |= bit;
+				masks.structural |= bit;
+				break;
+			case '(':
+			case ')':
+			case ';':
+			case ',':
+			case '[':
+			case ']':
+			case '+':
+			case '-':
+				masks.structural |= bit;
+				break;
+			case '*':
+				masks.structural |= bit;
+				masks.stars |= bit;
+				break;
+			case '\n': masks.newlines |= bit; break;
+			case '/': masks.slashes |= bit; break;
+			default: break;
+		}
+	}
+	return masks;
+}
+
+#if FISKA_SIMD_X86
+#define FISKA_DEFINE_CLASSIFY(name, V, target)                                               \
+	target auto name(const char *p) -> BlockMasks {                                           \
+		BlockMasks masks;                                                                     \
+		for (usz k = 0; k < 64; k += V::width) {                                              \
+			V::Vec v = V::load(p + k);                                                        \
+			V::Vec braces = V::or_(V::eq(v, '{'), V::eq(v, '}'));                            \
+			/* '(' up to '-' is "()*+,-". */                                                  \
+			V::Vec structural = V::or_(                                                       \
+				V::or_(V::in_range(v, '(', '-'), V::or_(V::eq(v, '['), V::eq(v, ']'))),       \
+				V::or_(braces, V::eq(v, ';')));                                               \
+			masks.braces |= u64(V::mask(braces)) << k;                                        \
+			masks.structural |= u64(V::mask(structural)) << k;                                \
+			masks.newlines |= u64(V::mask(V::eq(v, '\n'))) << k;                              \
+			masks.slashes |= u64(V::mask(V::eq(v, '/'))) << k;                                \
+			masks.stars |= u64(V::mask(V::eq(v, '*'))) << k;                                  \
+		}                                                                                     \
+		return masks;                                                                         \
+	}
+
+FISKA_DEFINE_CLASSIFY(sse2_classify, simd::Sse2, )
+FISKA_DEFINE_CLASSIFY(avx2_classify, simd::Avx2, [[gnu::target("avx2")]])
+
+#undef FISKA_DEFINE_CLASSIFY
+#endif // FISKA_SIMD_X86
+
+using ClassifyFn = auto (*)(const char *) -> BlockMasks;
+
+auto classify_fn_of_isa(Isa isa) -> ClassifyFn {
+	switch (isa) {
+		case Isa::Scalar: return scalar_classify;
+#if FISKA_SIMD_X86
+		case Isa::Sse2: return sse2_classify;
+		case Isa::Avx2: return avx2_classify;
+#else
+		case Isa::Sse2:
+		case Isa::Avx2:
+			fiska_unreachable("SIMD scanners are only available on x86");
+#endif
+	}
+	fiska_unreachable();
+}
+
+} // namespace
+
+auto StructuralIndex::build(std::string_view source) -> StructuralIndex {
+	ClassifyFn classify = classify_fn_of_isa(active_isa());
+
+	usz num_words = (source.size() + 63) / 64;
+	StructuralIndex index;
+	index.size = source.size();
+	index.structural.resize(num_words);
+	index.braces.resize(num_words);
+	index.newlines.resize(num_words);
+	index.comment_starts.resize(num_words);
+
+	// A comment starts at a '/' whose next byte is a '/' or a '*'. The next byte
+	// can live in the following block, so each block hands its slashes over to
+	// the next one, which completes them.
+	u64 pending_slashes = 0;
+	auto handle_block = [&](usz word, BlockMasks masks) {
+		index.structural[word] = masks.structural;
+		index.braces[word] = masks.braces;
+		index.newlines[word] = masks.newlines;
+
+		u64 comment_seconds = masks.slashes | masks.stars;
+		if (word > 0) {
+			index.comment_starts[word - 1] |= (comment_seconds & 1) ? pending_slashes & (u64(1) << 63) : 0;
+		}
+		index.comment_starts[word] = masks.slashes & (comment_seconds >> 1);
+		pending_slashes = masks.slashes;
+	};
+
+	usz full_words = source.size() / 64;
+	for (usz word = 0; word < full_words; ++word) {
+		handle_block(word, classify(source.data() + word * 64));
+	}
+
+	if (full_words != num_words) {
+		// Pad the tail with spaces, which are not part of any class.
+		char tail[64];
+		std::memset(tail, ' ', sizeof tail);
+		std::memcpy(tail, source.data() + full_words * 64, source.size() - full_words * 64);
+		handle_block(full_words, classify(tail));
+	}
+
+	return index;
+}
+
+} // namespace scan
+} // namespace fiskas
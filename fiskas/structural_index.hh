@@ -0,0 +1,58 @@
+#ifndef __FISKA_ASSEMBLER_FISKAS_STRUCTURAL_INDEX_HH__
+#define __FISKA_ASSEMBLER_FISKAS_STRUCTURAL_INDEX_HH__
+
+#include <vector>
+
+#include "base.hh"
+
+namespace fiskas {
+namespace scan {
+
+// Bitmaps with one bit per source byte marking the characters that give the
+// source its structure. They are built in a single vectorized pass, after which
+// boundaries can be found by jumping from set bit to set bit instead of looking
+// at every byte.
+//
+// The bitmaps are purely lexical: a brace inside a comment is still marked,
+// and it's up to the user of the index to skip comments.
+struct StructuralIndex {
+	// The one char tokens: '(', ')', '{', '}', '[', ']', ';', ',', '+', '-', '*'.
+	std::vector<u64> structural;
+	// The '{' and '}' subset of |structural|.
+	std::vector<u64> braces;
+	// '\n'.
+	std::vector<u64> newlines;
+	// A '/' followed by either '/' or '*'.
+	std::vector<u64> comment_starts;
+	usz size{};
+
+public:
+	static auto build(std::string_view source) -> StructuralIndex;
+
+	// Offset of the first bit set at or after |pos| in |bitmap|, or |size| if there is none.
+	auto next_set(const std::vector<u64> &bitmap, usz pos) const -> usz {
+		usz word = pos / 64;
+		if (word >= bitmap.size()) return size;
+
+		u64 bits = bitmap[word] & (~u64(0) << (pos % 64));
+		while (bits == 0) {
+			if (++word == bitmap.size()) return size;
+			bits = bitmap[word];
+		}
+		return std::min(size, word * 64 + usz(__builtin_ctzll(bits)));
+	}
+
+	auto next_structural(usz pos) const -> usz { return next_set(structural, pos); }
+	auto next_brace(usz pos) const -> usz { return next_set(braces, pos); }
+	auto next_newline(usz pos) const -> usz { return next_set(newlines, pos); }
+	auto next_comment_start(usz pos) const -> usz { return next_set(comment_starts, pos); }
+
+	auto is_set(const std::vector<u64> &bitmap, usz pos) const -> bool {
+		return (bitmap[pos / 64] >> (pos % 64)) & 1;
+	}
+};
+
+} // namespace scan
+} // namespace fiskas
+
+#endif // __FISKA_ASSEMBLER_FISKAS_STRUCTURAL_INDEX_HH__
@@ -0,0 +1,72 @@
+#include <limits>
+
+#include "base.hh"
+#include "token_buffer.hh"
+
+namespace fiskas {
+namespace lexer {
+
+auto StringInterner::intern(std::string_view str) -> u32 {
+	if (auto id = find(str)) return *id;
+
+	u32 id = u32(strings.size());
+	const std::string &owned = strings.emplace_back(str);
+	ids.emplace(owned, id);
+	return id;
+}
+
+auto StringInterner::find(std::string_view str) const -> std::optional<u32> {
+	auto id_it = ids.find(str);
+	if (id_it == ids.end()) return std::nullopt;
+	return id_it->second;
+}
+
+auto TokenBuffer::storable(Lexer &lexer, Token tok) -> Token {
+	if (tok.len <= max_token_len) return tok;
+
+	lexer.report(lexer.error(tok.offset, "Token is {} bytes long, the limit is {}", tok.len, max_token_len));
+	return Token::gen(TokenKind::Invalid, tok.offset, max_token_len);
+}
+
+auto TokenBuffer::push(Lexer &lexer, Token tok) -> void {
+	fiska_assert(tok.offset <= std::numeric_limits<u32>::max(),
+			"Token offset '{}' does not fit in 32 bits", tok.offset);
+	tok = storable(lexer, tok);
+
+	kinds.push_back(u8(+tok.kind));
+	offsets.push_back(u32(tok.offset));
+	lengths.push_back(u16(tok.len));
+	payloads.push_back(payload_of(tok, lexer.literal(tok)));
+}
+
+auto TokenBuffer::payload_of(const Token &tok, std::string_view literal) -> u32 {
+	switch (tok.kind) {
+		case TokenKind::Identifier:
+			return identifiers.intern(literal);
+
+		case TokenKind::Number:
+			numbers.push_back(tok.value);
+			return u32(numbers.size() - 1);
+
+		default:
+			return no_payload;
+	}
+}
+
+auto TokenBuffer::lex(std::string_view source, Diagnostics *diagnostics) -> TokenBuffer {
+	fiska_assert(source.size() <= std::numeric_limits<u32>::max(),
+			"Source of {} bytes is too big for a token buffer", source.size());
+
+	TokenBuffer buffer;
+	Lexer lexer{source};
+	lexer.diagnostics = diagnostics;
+	while (true) {
+		Token tok = lexer.next_token();
+		buffer.push(lexer, tok);
+		if (tok.kind == TokenKind::Eof) break;
+	}
+	return buffer;
+}
+
+} // namespace lexer
+} // namespace fiskas
@@ -0,0 +1,92 @@
+#ifndef __FISKA_ASSEMBLER_FISKAS_TOKEN_BUFFER_HH__
+#define __FISKA_ASSEMBLER_FISKAS_TOKEN_BUFFER_HH__
+
+#include <deque>
+#include <limits>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "base.hh"
+#include "lexer.hh"
+
+namespace fiskas {
+namespace lexer {
+
+// Hands out a dense id for every distinct string. The interner keeps its own
+// copy of each string, so ids stay valid after the source they came from is gone.
+struct StringInterner {
+	// std::deque never moves its elements, so the views used as keys stay valid.
+	std::deque<std::string> strings;
+	std::unordered_map<std::string_view, u32> ids;
+
+public:
+	auto intern(std::string_view str) -> u32;
+	auto find(std::string_view str) const -> std::optional<u32>;
+	auto str(u32 id) const -> std::string_view { return strings[id]; }
+	auto size() const -> usz { return strings.size(); }
+};
+
+// All the tokens of a source file, stored as a structure of arrays.
+//
+// A token costs 11 bytes (kind + offset + length + payload) instead of the 32
+// bytes of a |Token|, and any token can be looked at in O(1), which gives the
+// parser unlimited lookahead. The last token of the buffer is always |Eof|.
+struct TokenBuffer {
+	std::vector<u8> kinds;
+	std::vector<u32> offsets;
+	std::vector<u16> lengths;
+	// Id in |identifiers| for identifier tokens and index in |numbers| for number
+	// tokens. Unused for the other kinds.
+	std::vector<u32> payloads;
+	StringInterner identifiers;
+	// Values of the number tokens. Numbers are rare enough that keeping their
+	// 8 byte value out of the per token columns is a win.
+	std::vector<u64> numbers;
+
+public:
+	constexpr static usz bytes_per_token = sizeof(u8) + sizeof(u32) + sizeof(u16) + sizeof(u32);
+	constexpr static u32 no_payload = ~u32(0);
+	// Longest token the buffer can hold.
+	constexpr static usz max_token_len = std::numeric_limits<u16>::max();
+
+	// Tokenize |source| in one go. Errors go to |diagnostics| if there is one,
+	// otherwise the first one ends the process.
+	static auto lex(std::string_view source, Diagnostics *diagnostics = nullptr) -> TokenBuffer;
+
+	// |tok| as the buffer stores it. A token longer than |max_token_len| is
+	// reported to |lexer| and becomes an |Invalid| token cut to that length.
+	static auto storable(Lexer &lexer, Token tok) -> Token;
+	// Append |tok|, which |lexer| just lexed.
+	auto push(Lexer &lexer, Token tok) -> void;
+	// Payload to store for |tok|, interning or recording whatever it refers to.
+	auto payload_of(const Token &tok, std::string_view literal) -> u32;
+
+	auto size() const -> usz { return kinds.size(); }
+	auto kind(usz idx) const -> TokenKind { return TokenKind(kinds[idx]); }
+	auto token(usz idx) const -> Token {
+		return Token::gen(kind(idx), offsets[idx], lengths[idx]);
+	}
+	// Where token |idx| ends in the source. Cut tokens end before the next one.
+	auto end_of(usz idx) const -> usz {
+		if (lengths[idx] == max_token_len) return offsets[idx + 1];
+		return usz(offsets[idx]) + lengths[idx];
+	}
+	auto ident_id(usz idx) const -> u32 {
+		fiska_assert(kind(idx) == TokenKind::Identifier,
+				"Token '{}' is a {}, not an identifier", idx, str_of_token_kind(kind(idx)));
+		return payloads[idx];
+	}
+	auto ident(usz idx) const -> std::string_view { return identifiers.str(ident_id(idx)); }
+	auto number(usz idx) const -> u64 {
+		fiska_assert(kind(idx) == TokenKind::Number,
+				"Token '{}' is a {}, not a number", idx, str_of_token_kind(kind(idx)));
+		return numbers[payloads[idx]];
+	}
+};
+
+} // namespace lexer
+} // namespace fiskas
+
+#endif // __FISKA_ASSEMBLER_FISKAS_TOKEN_BUFFER_HH__
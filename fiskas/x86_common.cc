@@ -1,3 +1,4 @@
+#include <bit>
 #include <string_view>
 #include <optional>
 #include <vector>
@@ -8,46 +9,16 @@
 namespace fiskas {
 namespace common {
 
-const StringMap<X86Mnemonic> mnemonics = {
-	{"mov", X86Mnemonic::Mov},
-	{"ret", X86Mnemonic::Ret}
-};
-
-const StringMap<RegName> regnames = {
-	{"rax", RegName::Rax},
-	{"rbx", RegName::Rbx},
-	{"rcx", RegName::Rcx},
-	{"rdx", RegName::Rdx},
-	{"rbp", RegName::Rbp},
-	{"rsi", RegName::Rsi},
-	{"rdi", RegName::Rdi},
-	{"rsp", RegName::Rsp},
-	{"r8", RegName::R8},
-	{"r9", RegName::R9},
-	{"r10", RegName::R10},
-	{"r11", RegName::R11},
-	{"r12", RegName::R12},
-	{"r13", RegName::R13},
-	{"r14", RegName::R14},
-	{"r15", RegName::R15},
-};
-
-auto x86_mnemonic_of_str(std::string_view mnemonic) -> std::optional<X86Mnemonic> {
-	auto mnemonic_it = mnemonics.find(mnemonic);
-	if (mnemonic_it == mnemonics.end()) return std::nullopt;
-	return mnemonic_it->second;
-}
-
 auto x86_mnemonic_of_str_pnc(std::string_view mnemonic) -> X86Mnemonic {
-	fiska_assert(mnemonics.contains(mnemonic), "Unrecognized mnemonic '{}'", mnemonic);
-	return mnemonics.find(mnemonic)->second;
+	auto x86_mnemonic = mnemonics.get(mnemonic);
+	fiska_assert(x86_mnemonic.has_value(), "Unrecognized mnemonic '{}'", mnemonic);
+	return *x86_mnemonic;
 }
 
 auto str_of_x86_mnemonic(X86Mnemonic mnemonic) -> std::string {
-	using enum X86Mnemonic;
 	switch (mnemonic) {
-		case Mov: return "mov";
-		case Ret: return "ret";
+#define FISKA_MNEMONIC(name, str) case X86Mnemonic::name: return str;
+#include "x86_instructions/instructions.def"
 	}
 	fiska_unreachable();
 }
@@ -102,6 +73,24 @@ auto str_of_reg_name(RegName reg_name) -> std::string {
 		case R14d: return "R14D";
 		case R15d: return "R15D";
 
+		// 16-bit
+		case Ax: return "AX";
+		case Bx: return "BX";
+		case Cx: return "CX";
+		case Dx: return "DX";
+		case Bp: return "BP";
+		case Si: return "SI";
+		case Di: return "DI";
+		case Sp: return "SP";
+		case R8w: return "R8W";
+		case R9w: return "R9W";
+		case R10w: return "R10W";
+		case R11w: return "R11W";
+		case R12w: return "R12W";
+		case R13w: return "R13W";
+		case R14w: return "R14W";
+		case R15w: return "R15W";
+
 		// Segment registers
 		case Cs: return "CS";
 		case Ds: return "DS";
@@ -136,249 +125,97 @@ auto str_of_reg_name(RegName reg_name) -> std::string {
 }
 
 auto reg_name_of_str_pnc(std::string_view reg_name) -> RegName {
-	fiska_assert(regnames.contains(reg_name), "Unrecognized register name '{}'", reg_name);
-	return regnames.find(reg_name)->second;
+	auto name = regnames.get(reg_name);
+	fiska_assert(name.has_value(), "Unrecognized register name '{}'", reg_name);
+	return *name;
 }
 
-auto reg_name_of_str(std::string_view reg_name) -> std::optional<RegName> {
-	if (not regnames.contains(reg_name)) return std::nullopt;
-	return regnames.find(reg_name)->second;
-}
+namespace {
 
-auto bit_width_of_reg_name(RegName reg_name) -> BitWidth {
-	using enum BitWidth;
+// Same address, rearranged so that it can be encoded or takes fewer bytes.
+auto normalized(MemRef mem) -> MemRef {
 	using enum RegName;
 
-	switch (reg_name) {
-		case Rax:
-		case Rbx:
-		case Rcx:
-		case Rdx:
-		case Rbp:
-		case Rsi:
-		case Rdi:
-		case Rsp:
-		case R8: 
-		case R9: 
-		case R10: 
-		case R11: 
-		case R12: 
-		case R13: 
-		case R14: 
-		case R15: 
-			return b64;
-
-		case Eax:
-		case Ebx:
-		case Ecx:
-		case Edx:
-		case Ebp:
-		case Esi:
-		case Edi:
-		case Esp:
-		case R8d:
-		case R9d:
-		case R10d:
-		case R11d:
-		case R12d:
-		case R13d:
-		case R14d:
-		case R15d:
-			return b32;
+	if (mem.scale != MemRef::Scale::One) return mem;
 
-		case Cs:
-		case Ds:
-		case Ss:
-		case Es:
-		case Fs:
-		case Gs:
-			return b16;
-
-		case Al:
-		case Cl:
-		case Dl:
-		case Bl:
-		case Ah:
-		case Ch:
-		case Dh:
-		case Bh:
-		case Spl:
-		case Bpl:
-		case Sil:
-		case Dil:
-		case R8b:
-		case R9b:
-		case R10b:
-		case R11b:
-		case R12b:
-		case R13b:
-		case R14b:
-		case R15b:
-			return b8;
+	// [rbx] doesn't need the SIB byte and the 4 bytes of displacement [rbx * 1] does.
+	if (not mem.base) {
+		std::swap(mem.base, mem.index);
+		return mem;
 	}
-	fiska_unreachable();
+	// rsp can only be a base.
+	if (mem.index == Rsp and mem.base != Rsp) std::swap(mem.base, mem.index);
+	return mem;
 }
 
-auto index_of_reg_name(RegName reg_name) -> u8 {
-	using enum RegName;
-	
-	switch (reg_name) {
-		case Rax: 
-		case Eax:
-		case Al:
-		case R8:
-		case R8d:
-		case R8b:
-		case Es:
-			return 0;
-
-		case Rcx:
-		case Ecx:
-		case Cl:
-		case R9:
-		case R9d:
-		case R9b:
-		case Cs:
-			return 1;
-
-		case Rdx:
-		case Edx:
-		case Dl:
-		case R10:
-		case R10d:
-		case R10b:
-		case Ss:
-			return 2;
+auto log2_of_scale(MemRef::Scale scale) -> u8 {
+	return u8(std::countr_zero(u8(+scale)));
+}
 
-		case Rbx:
-		case Ebx:
-		case Bl:
-		case R11:
-		case R11d:
-		case R11b:
-		case Ds:
-			return 3;
+} // namespace
 
-		case Rsp:
-		case Esp:
-		case Ah:
-		case Spl:
-		case R12:
-		case R12d:
-		case R12b:
-		case Fs:
-			return 4;
+auto str_of_mem_ref(const MemRef &mem) -> std::string {
+	std::string str = "[";
+	auto sep = [&] { return str.size() > 1 ? " + " : ""; };
 
-		case Rbp:
-		case Ebp:
-		case Ch:
-		case Bpl:
-		case R13:
-		case R13d:
-		case R13b:
-		case Gs:
-			return 5;
+	if (mem.base) str += str_of_reg_name(*mem.base);
+	if (mem.index) str += fmt::format("{}{}*{}", sep(), str_of_reg_name(*mem.index), +mem.scale);
+	if (mem.disp != 0 or str.size() == 1) str += fmt::format("{}{}", sep(), mem.disp);
+	return str + "]";
+}
 
-		case Rsi:
-		case Esi:
-		case Dh:
-		case Sil:
-		case R14:
-		case R14d:
-		case R14b:
-			return 6;
+auto validate_mem_ref(const MemRef &mem) -> std::optional<std::string> {
+	auto is_address_reg = [](RegName reg) {
+		return bit_width_of_reg_name(reg) == BitWidth::b64 and not is_segment_register(reg);
+	};
 
-		case Rdi:
-		case Edi:
-		case Dil:
-		case Bh:
-		case R15:
-		case R15d:
-		case R15b:
-			return 7;
+	if (mem.base and not is_address_reg(*mem.base)) {
+		return fmt::format("Base register '{}' is not a 64 bit general purpose register", str_of_reg_name(*mem.base));
 	}
-
-	fiska_unreachable();
+	if (mem.index and not is_address_reg(*mem.index)) {
+		return fmt::format("Index register '{}' is not a 64 bit general purpose register", str_of_reg_name(*mem.index));
+	}
+	if (normalized(mem).index == RegName::Rsp) return "RSP can't be used as an index register";
+	return std::nullopt;
 }
 
-auto requires_rex_extension(RegName reg_name) -> bool {
-	using enum RegName;
+auto encode_mem_ref(u8 reg, const MemRef &mem_) -> MemRefEncoding {
+	MemRef mem = normalized(mem_);
+	MemRefEncoding encoding;
 
-	switch (reg_name) {
-		case Spl:
-		case Bpl:
-		case Sil:
-		case Dil:
-		case R8:
-		case R9:
-		case R10:
-		case R11:
-		case R12:
-		case R13:
-		case R14:
-		case R15:
-		case R8d:
-		case R9d:
-		case R10d:
-		case R11d:
-		case R12d:
-		case R13d:
-		case R14d:
-		case R15d:
-		case R8b:
-		case R9b:
-		case R10b:
-		case R11b:
-		case R12b:
-		case R13b:
-		case R14b:
-		case R15b:
-			return true;
+	auto push = [&](u8 byte) { encoding.bytes.push_back(byte); };
+	auto push_disp32 = [&] { encoding.bytes.append_le(u32(mem.disp), sizeof(i32)); };
 
-		case Rax:
-		case Eax:
-		case Rcx:
-		case Ecx:
-		case Rdx:
-		case Edx:
-		case Rbx:
-		case Ebx:
-		case Rsp:
-		case Esp:
-		case Rbp:
-		case Ebp:
-		case Rsi:
-		case Esi:
-		case Rdi:
-		case Edi:
-		case Cs:
-		case Ds:
-		case Ss:
-		case Es:
-		case Fs:
-		case Gs:
-		case Al:
-		case Cl:
-		case Dl:
-		case Bl:
-		case Ah:
-		case Ch:
-		case Dh:
-		case Bh:
-			return false;
-	}
-	fiska_unreachable();
-}
+	u8 index = mem.index ? index_of_reg_name(*mem.index) : Sib::no_index;
+	encoding.rex_x = mem.index and requires_rex_extension(*mem.index);
 
-auto is_segment_register(RegName reg_name) -> bool {
-	using enum RegName;
+	if (not mem.base) {
+		// Mod 0b00 with r/m 0b101 is rip relative in 64 bit mode. The absolute
+		// address goes through a SIB byte without a base instead.
+		push(ModRm().mod(0b00).reg(reg).rm(0b100).value());
+		push(Sib().scale(log2_of_scale(mem.scale)).index(index).base(Sib::no_base).value());
+		push_disp32();
+		return encoding;
+	}
 
-	// We're not doing a switch statement here because this 
-	// function will not change if we add new registers in the future.
-	//
-	// An exhaustive switch statement allows the compiler to tell you what switch
-	// statements you need to update once you add a new enum variant.
-	return ::detail::one_of(reg_name, Cs, Ds, Ss, Es, Fs, Gs);
+	u8 base = index_of_reg_name(*mem.base);
+	encoding.rex_b = requires_rex_extension(*mem.base);
+
+	// r/m 0b100 (rsp and r12) means a SIB byte follows.
+	bool needs_sib = mem.index or base == 0b100;
+	// Mod 0b00 with a base of 0b101 (rbp and r13) means there is no base, so
+	// they always take a displacement.
+	u8 mod = [&] -> u8 {
+		if (mem.disp == 0 and base != 0b101) return 0b00;
+		if (mem.disp >= -128 and mem.disp <= 127) return 0b01;
+		return 0b10;
+	}();
+
+	push(ModRm().mod(mod).reg(reg).rm(needs_sib ? 0b100 : base).value());
+	if (needs_sib) push(Sib().scale(log2_of_scale(mem.scale)).index(index).base(base).value());
+	if (mod == 0b01) push(u8(mem.disp));
+	if (mod == 0b10) push_disp32();
+	return encoding;
 }
 
 } // namespace common
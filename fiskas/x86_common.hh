@@ -1,15 +1,22 @@
 #ifndef __FISKA_ASSEMBLER_FISKAS_X86_COMMON_HH__
 #define __FISKA_ASSEMBLER_FISKAS_X86_COMMON_HH__
 
+#include <array>
+#include <bit>
+#include <optional>
 #include <string>
 #include <string_view>
-#include <optional>
 
 #include "base.hh"
+#include "inline_bytes.hh"
 
 namespace fiskas {
 namespace common {
 
+// Longest encoding of an x86 instruction.
+constexpr usz max_instruction_size = 15;
+using InstructionBytes = InlineBytes<max_instruction_size>;
+
 struct ModRm {
 	constexpr static u8 register_addressing = 0b11;
 
@@ -37,6 +44,36 @@ public:
 	auto value() -> u8 { return byte; }
 };
 
+struct Sib {
+	// Index field meaning there is no index register.
+	constexpr static u8 no_index = 0b100;
+	// Base field meaning there is no base register when mod is 0b00.
+	constexpr static u8 no_base = 0b101;
+
+public:
+	u8 byte = 0;
+
+	auto scale(u8 log2_scale) -> Sib & {
+		fiska_assert(log2_scale <= 3, "Scale value '{}' in SIB byte can't be bigger than 0b11", log2_scale);
+		byte |= (log2_scale << 6);
+		return *this;
+	}
+
+	auto index(u8 value) -> Sib & {
+		fiska_assert(value <= 7, "Index value '{}' in SIB byte can't be bigger than 0b111", value);
+		byte |= (value << 3);
+		return *this;
+	}
+
+	auto base(u8 value) -> Sib & {
+		fiska_assert(value <= 7, "Base value '{}' in SIB byte can't be bigger than 0b111", value);
+		byte |= value;
+		return *this;
+	}
+
+	auto value() -> u8 { return byte; }
+};
+
 struct Rex {
 	constexpr static u8 fixed_field = 0b0100 << 4;
 	constexpr static u8 w_bit = 1 << 3;
@@ -46,6 +83,7 @@ struct Rex {
 
 public:
 	u8 byte = 0;
+	bool required = false;
 
 	auto w(bool need_w_prefix) -> Rex & {
 		byte |= need_w_prefix * w_bit;
@@ -58,28 +96,57 @@ public:
 	}
 
 	auto x(bool need_x_prefix) -> Rex & {
-		byte |= need_x_prefix;
+		byte |= need_x_prefix * x_bit;
 		return *this;
 	}
 
 	auto b(bool need_b_prefix) -> Rex & {
-		byte |= need_b_prefix;
+		byte |= need_b_prefix * b_bit;
+		return *this;
+	}
+
+	// Emit the prefix even if no bit is set, see |requires_rex_prefix|.
+	auto present(bool need_prefix) -> Rex & {
+		required |= need_prefix;
 		return *this;
 	}
 
 	auto value() -> u8 {
 		// We don't need the rex prefix in this case.
-		if (byte == 0) return 0;
+		if (byte == 0 and not required) return 0;
 		
 		return fixed_field | byte;
 	}
 };
 
-enum struct X86Mnemonic {
-    Mov,
-    Ret
+// Operand size override, for instructions on 16 bit operands.
+constexpr u8 operand_size_prefix = 0x66;
+
+// Append the prefixes that go before the opcode. Only the ones that are needed
+// are emitted: 0x66 if |operand_size_override| and the REX prefix if |rex|
+// has a bit set or was asked to be present.
+inline auto emit_prefixes(InstructionBytes &bytes, bool operand_size_override, Rex rex) -> void {
+	if (operand_size_override) bytes.push_back(operand_size_prefix);
+	if (u8 rex_prefix = rex.value()) bytes.push_back(rex_prefix);
+}
+
+// Whether |imm| fits in |width| bits, either as an unsigned value or as a
+// negative signed one, e.g 255 and -128 fit in 8 bits but 256 and -129 don't.
+constexpr auto fits_in_width(u64 imm, u32 width) -> bool {
+	if (width >= 64 or imm >> width == 0) return true;
+	return i64(imm) < 0 and i64(imm) >= -(i64(1) << (width - 1));
+}
+
+// See |x86_instructions/instructions.def|.
+enum struct X86Mnemonic : u8 {
+#define FISKA_MNEMONIC(name, str) name,
+#include "x86_instructions/instructions.def"
 };
-auto x86_mnemonic_of_str(std::string_view mnemonic) -> std::optional<X86Mnemonic>;
+#define FISKA_MNEMONIC(name, str) +1
+constexpr usz num_x86_mnemonics = 0
+#include "x86_instructions/instructions.def"
+;
+constexpr auto x86_mnemonic_of_str(std::string_view mnemonic) -> std::optional<X86Mnemonic>;
 auto x86_mnemonic_of_str_pnc(std::string_view mnemonic) -> X86Mnemonic;
 auto str_of_x86_mnemonic(X86Mnemonic mnemonic) -> std::string;
 
@@ -102,6 +169,11 @@ enum struct RegName {
 	Edi, Esp, R8d, R9d, R10d, R11d,
 	R12d, R13d, R14d, R15d,
 
+	// 16 bit GPRs
+	Ax, Bx, Cx, Dx, Bp, Si,
+	Di, Sp, R8w, R9w, R10w, R11w,
+	R12w, R13w, R14w, R15w,
+
 	// 8-bit GPRs
 	Al, Cl, Dl, Bl, Ah, Ch, Dh,
 	Bh, Spl, Bpl, Sil, Dil, R8b,
@@ -111,13 +183,209 @@ enum struct RegName {
 	// Segment registers
 	Cs, Ds, Ss, Es, Fs, Gs,
 };
+// Gs is the last register.
+constexpr usz num_reg_names = usz(RegName::Gs) + 1;
+
 auto str_of_reg_name(RegName reg_name) -> std::string;
 auto reg_name_of_str_pnc(std::string_view reg_name) -> RegName; 
-auto reg_name_of_str(std::string_view reg_name) -> std::optional<RegName>;
-auto bit_width_of_reg_name(RegName reg_name) -> BitWidth;
-auto index_of_reg_name(RegName reg_name) -> u8;
-auto requires_rex_extension(RegName reg_name) -> bool;
-auto is_segment_register(RegName reg_name) -> bool;
+constexpr auto reg_name_of_str(std::string_view reg_name) -> std::optional<RegName>;
+constexpr auto bit_width_of_reg_name(RegName reg_name) -> BitWidth;
+constexpr auto index_of_reg_name(RegName reg_name) -> u8;
+// Whether the register needs the R, X or B bit of the REX prefix.
+constexpr auto requires_rex_extension(RegName reg_name) -> bool;
+// Whether the register can only be encoded with a REX prefix, even without any
+// bit set. SPL, BPL, SIL and DIL are in that case on top of the extended ones.
+constexpr auto requires_rex_prefix(RegName reg_name) -> bool;
+// Whether the register can't be encoded when a REX prefix is present. Only
+// AH, CH, DH and BH are in that case.
+constexpr auto forbids_rex_prefix(RegName reg_name) -> bool;
+constexpr auto is_segment_register(RegName reg_name) -> bool;
+
+enum struct RegClass : u8 {
+	Gpr,
+	Segment,
+};
+
+// Everything the encoders need to know about a register, in two bytes.
+struct RegDescriptor {
+	// 0 to 15. The low 3 bits go in ModRM, SIB or the opcode and bit 3 in
+	// the REX prefix.
+	u16 num : 4;
+	bool rex_required : 1;
+	bool rex_forbidden : 1;
+	// The width is 8 << |log2_width_bytes|.
+	u16 log2_width_bytes : 2;
+	RegClass reg_class : 1;
+
+public:
+	constexpr auto width() const -> BitWidth { return BitWidth(8 << log2_width_bytes); }
+	constexpr auto index() const -> u8 { return u8(num & 0b111); }
+	constexpr auto extended() const -> bool { return num >> 3; }
+};
+static_assert(sizeof(RegDescriptor) == 2);
+
+// Descriptors of all the registers, indexed by |RegName|.
+inline constexpr auto reg_descriptors = [] {
+	using enum RegName;
+	using enum BitWidth;
+
+	std::array<RegDescriptor, num_reg_names> table{};
+	std::array<bool, num_reg_names> filled{};
+	auto add = [&](RegName name, u8 num, BitWidth width, RegClass reg_class, bool rex_required, bool rex_forbidden) {
+		if (filled[usz(name)]) throw "Register described twice";
+		filled[usz(name)] = true;
+
+		RegDescriptor &desc = table[usz(name)];
+		desc.num = num & 0xf;
+		desc.rex_required = rex_required;
+		desc.rex_forbidden = rex_forbidden;
+		desc.log2_width_bytes = std::countr_zero(u16(+width / 8)) & 0b11;
+		desc.reg_class = reg_class;
+	};
+
+	// |names| in the order of their numbers.
+	auto gprs = [&](BitWidth width, std::array<RegName, 16> names) {
+		for (u8 num = 0; num < names.size(); ++num) {
+			// Without a REX prefix, 8 bit registers 4 to 7 are AH, CH, DH and BH.
+			bool rex_required = num >= 8 or (width == b8 and num >= 4);
+			add(names[num], num, width, RegClass::Gpr, rex_required, false);
+		}
+	};
+	gprs(b64, {Rax, Rcx, Rdx, Rbx, Rsp, Rbp, Rsi, Rdi, R8, R9, R10, R11, R12, R13, R14, R15});
+	gprs(b32, {Eax, Ecx, Edx, Ebx, Esp, Ebp, Esi, Edi, R8d, R9d, R10d, R11d, R12d, R13d, R14d, R15d});
+	gprs(b16, {Ax, Cx, Dx, Bx, Sp, Bp, Si, Di, R8w, R9w, R10w, R11w, R12w, R13w, R14w, R15w});
+	gprs(b8, {Al, Cl, Dl, Bl, Spl, Bpl, Sil, Dil, R8b, R9b, R10b, R11b, R12b, R13b, R14b, R15b});
+
+	u8 num = 4;
+	for (RegName name : {Ah, Ch, Dh, Bh}) add(name, num++, b8, RegClass::Gpr, false, true);
+
+	num = 0;
+	for (RegName name : {Es, Cs, Ss, Ds, Fs, Gs}) add(name, num++, b16, RegClass::Segment, false, false);
+
+	for (bool is_filled : filled) {
+		if (not is_filled) throw "Register without a descriptor";
+	}
+	return table;
+}();
+
+constexpr auto descriptor_of_reg_name(RegName reg_name) -> RegDescriptor {
+	return reg_descriptors[usz(reg_name)];
+}
+
+constexpr auto bit_width_of_reg_name(RegName reg_name) -> BitWidth {
+	return descriptor_of_reg_name(reg_name).width();
+}
+
+constexpr auto index_of_reg_name(RegName reg_name) -> u8 {
+	return descriptor_of_reg_name(reg_name).index();
+}
+
+constexpr auto requires_rex_extension(RegName reg_name) -> bool {
+	return descriptor_of_reg_name(reg_name).extended();
+}
+
+constexpr auto requires_rex_prefix(RegName reg_name) -> bool {
+	return descriptor_of_reg_name(reg_name).rex_required;
+}
+
+constexpr auto forbids_rex_prefix(RegName reg_name) -> bool {
+	return descriptor_of_reg_name(reg_name).rex_forbidden;
+}
+
+constexpr auto is_segment_register(RegName reg_name) -> bool {
+	return descriptor_of_reg_name(reg_name).reg_class == RegClass::Segment;
+}
+
+// Perfect hash tables built at compile time. See |StaticStringMap|.
+inline constexpr auto mnemonics = make_static_string_map<X86Mnemonic>({
+#define FISKA_MNEMONIC(name, str) {str, X86Mnemonic::name},
+#include "x86_instructions/instructions.def"
+});
+
+inline constexpr auto regnames = make_static_string_map<RegName>({
+	{"rax", RegName::Rax},
+	{"rbx", RegName::Rbx},
+	{"rcx", RegName::Rcx},
+	{"rdx", RegName::Rdx},
+	{"rbp", RegName::Rbp},
+	{"rsi", RegName::Rsi},
+	{"rdi", RegName::Rdi},
+	{"rsp", RegName::Rsp},
+	{"r8", RegName::R8},
+	{"r9", RegName::R9},
+	{"r10", RegName::R10},
+	{"r11", RegName::R11},
+	{"r12", RegName::R12},
+	{"r13", RegName::R13},
+	{"r14", RegName::R14},
+	{"r15", RegName::R15},
+	{"eax", RegName::Eax},
+	{"ebx", RegName::Ebx},
+	{"ecx", RegName::Ecx},
+	{"edx", RegName::Edx},
+	{"ebp", RegName::Ebp},
+	{"esi", RegName::Esi},
+	{"edi", RegName::Edi},
+	{"esp", RegName::Esp},
+	{"r8d", RegName::R8d},
+	{"r9d", RegName::R9d},
+	{"r10d", RegName::R10d},
+	{"r11d", RegName::R11d},
+	{"r12d", RegName::R12d},
+	{"r13d", RegName::R13d},
+	{"r14d", RegName::R14d},
+	{"r15d", RegName::R15d},
+	{"ax", RegName::Ax},
+	{"bx", RegName::Bx},
+	{"cx", RegName::Cx},
+	{"dx", RegName::Dx},
+	{"bp", RegName::Bp},
+	{"si", RegName::Si},
+	{"di", RegName::Di},
+	{"sp", RegName::Sp},
+	{"r8w", RegName::R8w},
+	{"r9w", RegName::R9w},
+	{"r10w", RegName::R10w},
+	{"r11w", RegName::R11w},
+	{"r12w", RegName::R12w},
+	{"r13w", RegName::R13w},
+	{"r14w", RegName::R14w},
+	{"r15w", RegName::R15w},
+	{"al", RegName::Al},
+	{"cl", RegName::Cl},
+	{"dl", RegName::Dl},
+	{"bl", RegName::Bl},
+	{"ah", RegName::Ah},
+	{"ch", RegName::Ch},
+	{"dh", RegName::Dh},
+	{"bh", RegName::Bh},
+	{"spl", RegName::Spl},
+	{"bpl", RegName::Bpl},
+	{"sil", RegName::Sil},
+	{"dil", RegName::Dil},
+	{"r8b", RegName::R8b},
+	{"r9b", RegName::R9b},
+	{"r10b", RegName::R10b},
+	{"r11b", RegName::R11b},
+	{"r12b", RegName::R12b},
+	{"r13b", RegName::R13b},
+	{"r14b", RegName::R14b},
+	{"r15b", RegName::R15b},
+	{"cs", RegName::Cs},
+	{"ds", RegName::Ds},
+	{"ss", RegName::Ss},
+	{"es", RegName::Es},
+	{"fs", RegName::Fs},
+	{"gs", RegName::Gs},
+});
+
+constexpr auto x86_mnemonic_of_str(std::string_view mnemonic) -> std::optional<X86Mnemonic> {
+	return mnemonics.get(mnemonic);
+}
+
+constexpr auto reg_name_of_str(std::string_view reg_name) -> std::optional<RegName> {
+	return regnames.get(reg_name);
+}
 
 
 struct Reg {
@@ -125,6 +393,53 @@ struct Reg {
 	BitWidth width;
 };
 
+// [base + index * scale + disp]. Either register can be left out.
+struct MemRef {
+	enum struct Scale : u8 {
+		One = 1,
+		Two = 2,
+		Four = 4,
+		Eight = 8,
+	};
+
+	std::optional<RegName> base;
+	std::optional<RegName> index;
+	Scale scale = Scale::One;
+	i32 disp{};
+
+public:
+	auto operator==(const MemRef &other) const -> bool = default;
+};
+auto str_of_mem_ref(const MemRef &mem) -> std::string;
+constexpr auto scale_of_int(u64 value) -> std::optional<MemRef::Scale> {
+	switch (value) {
+		case 1: return MemRef::Scale::One;
+		case 2: return MemRef::Scale::Two;
+		case 4: return MemRef::Scale::Four;
+		case 8: return MemRef::Scale::Eight;
+		default: return std::nullopt;
+	}
+}
+
+// Why |mem| can't be encoded, if it can't.
+auto validate_mem_ref(const MemRef &mem) -> std::optional<std::string>;
+
+// The bytes addressing a memory operand, in the order they follow the opcode.
+struct MemRefEncoding {
+	// ModRM, then the SIB byte and the displacement if there are any.
+	InlineBytes<6> bytes;
+	// Extensions of the base and index registers the REX prefix must carry.
+	bool rex_x{};
+	bool rex_b{};
+};
+
+// Shortest encoding of |mem| with |reg| in the reg field of the ModRM byte. A
+// SIB byte is only used when the registers require one and the displacement
+// takes 0, 1 or 4 bytes depending on its value.
+//
+// |mem| must be valid, see |validate_mem_ref|.
+auto encode_mem_ref(u8 reg, const MemRef &mem) -> MemRefEncoding;
+
 } // namespace common
 } // namespace fiskas
 
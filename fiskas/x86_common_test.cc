@@ -0,0 +1,261 @@
+#include <gtest/gtest.h>
+
+#include "base.hh"
+#include "lexer.hh"
+#include "x86_common.hh"
+#include "x86_instructions/mov/mov.hh"
+#include "x86_instructions/static_encoder.hh"
+
+namespace fiskas {
+namespace common {
+namespace test {
+
+// The tables are usable in constant expressions.
+static_assert(regnames.get("r12") == RegName::R12);
+static_assert(not mnemonics.contains("movq"));
+static_assert(lexer::Lexer::keywords.get("fn") == lexer::TokenKind::Fn);
+
+TEST(StaticStringMap, FindsEveryKey) {
+	usz count = 0;
+	for (const auto &[key, value] : regnames.items()) {
+		EXPECT_EQ(reg_name_of_str(key), value);
+		count++;
+	}
+	EXPECT_EQ(count, regnames.size());
+
+	EXPECT_EQ(x86_mnemonic_of_str("mov"), X86Mnemonic::Mov);
+	EXPECT_EQ(x86_mnemonic_of_str("ret"), X86Mnemonic::Ret);
+}
+
+TEST(StaticStringMap, RejectsUnknownKeys) {
+	for (std::string_view key : {"", "r", "ra", "raxx", "RAX", "r16", "r1", "rax ", "xmm0"}) {
+		EXPECT_FALSE(reg_name_of_str(key).has_value()) << key;
+	}
+	for (std::string_view key : {"", "m", "mo", "movv", "MOV", "re", "rett"}) {
+		EXPECT_FALSE(x86_mnemonic_of_str(key).has_value()) << key;
+	}
+	EXPECT_FALSE(lexer::Lexer::keywords.contains("f"));
+	EXPECT_FALSE(lexer::Lexer::keywords.contains("fnn"));
+}
+
+TEST(StaticStringMap, ManyKeys) {
+	constexpr auto map = make_static_string_map<int>({
+		{"a", 0}, {"b", 1}, {"c", 2}, {"d", 3}, {"e", 4}, {"f", 5}, {"g", 6}, {"h", 7},
+		{"aa", 8}, {"ab", 9}, {"ac", 10}, {"ad", 11}, {"ae", 12}, {"af", 13}, {"ag", 14},
+		{"ah", 15}, {"abc", 16}, {"abd", 17}, {"abe", 18}, {"abf", 19}, {"abg", 20},
+		{"a_long_key", 21}, {"a_longer_key", 22}, {"the_longest_key_of_them_all", 23},
+	});
+
+	usz count = 0;
+	for (const auto &[key, value] : map.items()) {
+		EXPECT_EQ(map.get(key), value);
+		count++;
+	}
+	EXPECT_EQ(count, 24u);
+	EXPECT_FALSE(map.contains("abh"));
+	EXPECT_FALSE(map.contains("a_long"));
+}
+
+static_assert(sizeof(reg_descriptors) == 2 * num_reg_names);
+static_assert(bit_width_of_reg_name(RegName::R13w) == BitWidth::b16);
+static_assert(index_of_reg_name(RegName::R13w) == 5 and requires_rex_extension(RegName::R13w));
+static_assert(requires_rex_prefix(RegName::Sil) and not requires_rex_extension(RegName::Sil));
+static_assert(forbids_rex_prefix(RegName::Dh) and index_of_reg_name(RegName::Dh) == 6);
+static_assert(is_segment_register(RegName::Fs) and index_of_reg_name(RegName::Fs) == 4);
+
+TEST(RegDescriptor, EveryNameParses) {
+	// Every register can be written in lowercase.
+	for (usz idx = 0; idx < num_reg_names; ++idx) {
+		RegName name = RegName(idx);
+		std::string str = str_of_reg_name(name);
+		std::ranges::transform(str, str.begin(), [](char c) { return char(std::tolower(c)); });
+		EXPECT_EQ(reg_name_of_str(str), name) << str;
+	}
+	EXPECT_EQ(regnames.size(), num_reg_names);
+}
+
+TEST(RegDescriptor, MatchesTheRegisterNames) {
+	for (usz idx = 0; idx < num_reg_names; ++idx) {
+		RegName name = RegName(idx);
+		std::string str = str_of_reg_name(name);
+		RegDescriptor desc = descriptor_of_reg_name(name);
+
+		// R8 to R15, in any width, are the extended ones.
+		bool numbered = str.size() >= 2 and str[0] == 'R' and std::isdigit(str[1]);
+		EXPECT_EQ(desc.extended(), numbered) << str;
+		EXPECT_EQ(desc.rex_forbidden, str.size() == 2 and str[1] == 'H') << str;
+		EXPECT_FALSE(desc.rex_required and desc.rex_forbidden) << str;
+	}
+}
+
+// Just enough of a decoder to read back a mov between two registers.
+struct DecodedMov {
+	bool operand_size_override{};
+	std::optional<u8> rex;
+	u8 opcode{};
+	// Register numbers, REX extension included.
+	u8 reg{};
+	u8 rm{};
+	usz len{};
+};
+
+auto decode_mov(std::span<const u8> bytes) -> DecodedMov {
+	DecodedMov mov;
+	usz i = 0;
+	if (bytes[i] == operand_size_prefix) {
+		mov.operand_size_override = true;
+		++i;
+	}
+	if ((bytes[i] & 0xf0) == Rex::fixed_field) mov.rex = bytes[i++];
+	mov.opcode = bytes[i++];
+
+	u8 modrm = bytes[i++];
+	EXPECT_EQ(modrm >> 6, ModRm::register_addressing);
+	u8 rex = mov.rex.value_or(0);
+	mov.reg = u8(((rex & Rex::r_bit) ? 8 : 0) | ((modrm >> 3) & 7));
+	mov.rm = u8(((rex & Rex::b_bit) ? 8 : 0) | (modrm & 7));
+	mov.len = i;
+	return mov;
+}
+
+auto register_number(RegName reg) -> u8 {
+	return u8(index_of_reg_name(reg) + (requires_rex_extension(reg) ? 8 : 0));
+}
+
+TEST(MovEncoding, DecodesBackToTheSameRegisters) {
+	using enum RegName;
+	constexpr RegName gprs[][16] = {
+		{Rax, Rcx, Rdx, Rbx, Rsp, Rbp, Rsi, Rdi, R8, R9, R10, R11, R12, R13, R14, R15},
+		{Eax, Ecx, Edx, Ebx, Esp, Ebp, Esi, Edi, R8d, R9d, R10d, R11d, R12d, R13d, R14d, R15d},
+		{Ax, Cx, Dx, Bx, Sp, Bp, Si, Di, R8w, R9w, R10w, R11w, R12w, R13w, R14w, R15w},
+		{Al, Cl, Dl, Bl, Spl, Bpl, Sil, Dil, R8b, R9b, R10b, R11b, R12b, R13b, R14b, R15b},
+	};
+
+	for (const auto &regs : gprs) {
+		for (RegName dst : regs) {
+			for (RegName src : regs) {
+				Reg dst_reg{.name = dst, .width = bit_width_of_reg_name(dst)};
+				Reg src_reg{.name = src, .width = bit_width_of_reg_name(src)};
+				InstructionBytes bytes = x86_instruction::MovRegToReg{.dst = dst_reg, .src = src_reg}.encode();
+				DecodedMov mov = decode_mov(bytes.span());
+
+				std::string desc = fmt::format("mov({}, {})", str_of_reg_name(dst), str_of_reg_name(src));
+				ASSERT_EQ(mov.len, bytes.size()) << desc;
+				EXPECT_NE(bytes[0], 0x00) << desc;
+				EXPECT_EQ(mov.operand_size_override, dst_reg.width == BitWidth::b16) << desc;
+				EXPECT_EQ(mov.opcode, dst_reg.width == BitWidth::b8 ? 0x88 : 0x89) << desc;
+				EXPECT_EQ(mov.rm, register_number(dst)) << desc;
+				EXPECT_EQ(mov.reg, register_number(src)) << desc;
+
+				// A REX prefix only when the width or one of the registers needs it.
+				bool needs_rex = dst_reg.width == BitWidth::b64 or requires_rex_prefix(dst) or requires_rex_prefix(src);
+				EXPECT_EQ(mov.rex.has_value(), needs_rex) << desc;
+				EXPECT_EQ(mov.rex.has_value() and (*mov.rex & Rex::w_bit), dst_reg.width == BitWidth::b64) << desc;
+			}
+		}
+	}
+}
+
+TEST(MovEncoding, OnlyTheNeededPrefixes) {
+	using enum RegName;
+	auto encode = [](RegName dst, RegName src) {
+		return x86_instruction::MovRegToReg{
+			.dst = {.name = dst, .width = bit_width_of_reg_name(dst)},
+			.src = {.name = src, .width = bit_width_of_reg_name(src)},
+		}.encode();
+	};
+
+	// Expected bytes are the ones of GNU as.
+	EXPECT_EQ(encode(Ecx, Eax), (InstructionBytes{0x89, 0xc1}));
+	EXPECT_EQ(encode(R8d, Eax), (InstructionBytes{0x41, 0x89, 0xc0}));
+	EXPECT_EQ(encode(Al, Sil), (InstructionBytes{0x40, 0x88, 0xf0}));
+	EXPECT_EQ(encode(Sil, R9b), (InstructionBytes{0x44, 0x88, 0xce}));
+	EXPECT_EQ(encode(Ah, Bl), (InstructionBytes{0x88, 0xdc}));
+	EXPECT_EQ(encode(Rax, Ds), (InstructionBytes{0x8c, 0xd8}));
+	EXPECT_EQ(encode(Ds, Rax), (InstructionBytes{0x8e, 0xd8}));
+	EXPECT_EQ(encode(Rax, Rbx), (InstructionBytes{0x48, 0x89, 0xd8}));
+}
+
+namespace static_encoding {
+
+using namespace x86_instruction;
+
+template <X86Mnemonic mnemonic, typename... Operands>
+constexpr auto encode_static(Operands... operands) -> InstructionBytes {
+	std::array<u8, max_instruction_size> out{};
+	u8 *end = x86_instruction::encode<mnemonic>(out.data(), operands...);
+	InstructionBytes bytes;
+	for (u8 *byte = out.data(); byte != end; ++byte) bytes.push_back(*byte);
+	return bytes;
+}
+
+// Everything but the memory forms can run at compile time.
+static_assert(encode_static<X86Mnemonic::Mov>(regs::rcx, regs::rax) == InstructionBytes{0x48, 0x89, 0xc1});
+static_assert(encode_static<X86Mnemonic::Mov>(regs::ecx, regs::eax) == InstructionBytes{0x89, 0xc1});
+static_assert(encode_static<X86Mnemonic::Mov>(regs::al, regs::sil) == InstructionBytes{0x40, 0x88, 0xf0});
+static_assert(encode_static<X86Mnemonic::Ret>() == InstructionBytes{0xc3});
+
+// Operand types that aren't a form of the mnemonic don't compile.
+template <X86Mnemonic mnemonic, typename... Operands>
+concept Encodable = requires(u8 *out, Operands... operands) { x86_instruction::encode<mnemonic>(out, operands...); };
+static_assert(Encodable<X86Mnemonic::Mov, Reg64, Reg64>);
+static_assert(not Encodable<X86Mnemonic::Mov, Reg64, Reg32>);
+static_assert(not Encodable<X86Mnemonic::Mov, Reg32, Imm64>);
+static_assert(not Encodable<X86Mnemonic::Mov, Mem, Mem>);
+static_assert(not Encodable<X86Mnemonic::Ret, Reg64>);
+
+template <typename R>
+auto expect_reg_reg_like_mov(std::span<const RegName> names) -> void {
+	for (RegName dst : names) {
+		for (RegName src : names) {
+			MovRegToReg mov{
+				.dst = {.name = dst, .width = bit_width_of_reg_name(dst)},
+				.src = {.name = src, .width = bit_width_of_reg_name(src)},
+			};
+			if (not mov.validate_semantics()) continue;
+			EXPECT_EQ(encode_static<X86Mnemonic::Mov>(R::of(dst), R::of(src)), mov.encode())
+				<< fmt::format("mov({}, {})", str_of_reg_name(dst), str_of_reg_name(src));
+		}
+	}
+}
+
+TEST(StaticEncoder, RegRegLikeMov) {
+	using enum RegName;
+	constexpr RegName r64[] = {Rax, Rcx, Rdx, Rbx, Rsp, Rbp, Rsi, Rdi, R8, R9, R10, R11, R12, R13, R14, R15};
+	constexpr RegName r32[] = {Eax, Ecx, Edx, Ebx, Esp, Ebp, Esi, Edi, R8d, R9d, R10d, R11d, R12d, R13d, R14d, R15d};
+	constexpr RegName r8[] = {Al, Cl, Dl, Bl, Ah, Ch, Dh, Bh, Spl, Bpl, Sil, Dil, R8b, R9b, R10b, R11b, R12b, R13b, R14b, R15b};
+
+	expect_reg_reg_like_mov<Reg64>(r64);
+	expect_reg_reg_like_mov<Reg32>(r32);
+	expect_reg_reg_like_mov<Reg8>(r8);
+}
+
+TEST(StaticEncoder, Immediates) {
+	// Expected bytes are the ones of GNU as.
+	EXPECT_EQ(encode_static<X86Mnemonic::Mov>(regs::rax, Imm64{0x1122334455667788}),
+			(InstructionBytes{0x48, 0xb8, 0x88, 0x77, 0x66, 0x55, 0x44, 0x33, 0x22, 0x11}));
+	EXPECT_EQ(encode_static<X86Mnemonic::Mov>(regs::r9, Imm32{u64(-1)}),
+			(InstructionBytes{0x49, 0xc7, 0xc1, 0xff, 0xff, 0xff, 0xff}));
+	EXPECT_EQ(encode_static<X86Mnemonic::Mov>(regs::r10d, Imm32{42}), (InstructionBytes{0x41, 0xba, 0x2a, 0x00, 0x00, 0x00}));
+	EXPECT_EQ(encode_static<X86Mnemonic::Mov>(regs::cx, Imm16{0x1234}), (InstructionBytes{0x66, 0xb9, 0x34, 0x12}));
+	EXPECT_EQ(encode_static<X86Mnemonic::Mov>(regs::dil, Imm8{1}), (InstructionBytes{0x40, 0xb7, 0x01}));
+	EXPECT_EQ(encode_static<X86Mnemonic::Mov>(regs::ah, Imm8{1}), (InstructionBytes{0xb4, 0x01}));
+}
+
+TEST(StaticEncoder, MemoryLikeMov) {
+	using enum RegName;
+	MemRef mem{.base = R12, .index = Rcx, .scale = MemRef::Scale::Eight, .disp = -16};
+
+	EXPECT_EQ(encode_static<X86Mnemonic::Mov>(regs::r9, Mem{mem}),
+			(MovMemToReg{.dst = {.name = R9, .width = BitWidth::b64}, .src = mem}.encode()));
+	EXPECT_EQ(encode_static<X86Mnemonic::Mov>(Mem{mem}, regs::sil),
+			(MovRegToMem{.dst = mem, .src = {.name = Sil, .width = BitWidth::b8}}.encode()));
+	EXPECT_EQ(encode_static<X86Mnemonic::Mov>(regs::eax, Mem{mem}),
+			(MovMemToReg{.dst = {.name = Eax, .width = BitWidth::b32}, .src = mem}.encode()));
+}
+
+} // namespace static_encoding
+
+} // namespace test
+} // namespace common
+} // namespace fiskas
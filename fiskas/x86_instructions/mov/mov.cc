@@ -1,4 +1,4 @@
-#include <vector>
+#include <limits>
 
 #include "base.hh"
 #include "x86_instructions/mov/mov.hh"
@@ -6,90 +6,124 @@
 namespace fiskas {
 namespace x86_instruction {
 
-struct MovRegToReg : MovInstruction {
-	MovRegToReg(common::Reg dst_, common::Reg src_) 
-		: MovInstruction(MovInstructionKind::RegToReg),
-		  dst(dst_), src(src_) {}
+namespace {
 
-	common::Reg dst;
-	common::Reg src;
+// A register moved from or to memory. The width of the memory operand is the one of the register.
+auto validate_reg_mem(common::Reg reg, const common::MemRef &mem) -> std::expected<void, std::string> {
+	if (auto invalid = common::validate_mem_ref(mem)) return std::unexpected(*invalid);
 
-public:
-	auto validate_semantics() -> void;
-	auto encode() -> std::vector<u8>;
-};
+	bool needs_rex = reg.width == common::BitWidth::b64
+		or (mem.base and common::requires_rex_extension(*mem.base))
+		or (mem.index and common::requires_rex_extension(*mem.index));
+	if (needs_rex and common::forbids_rex_prefix(reg.name)) {
+		return std::unexpected(std::string(
+			"Registers AH, BH, CH, DH can't be addressed when a REX prefix is present"));
+	}
+	return {};
+}
 
-struct MovRegToMem : MovInstruction {
-	MovRegToMem() : MovInstruction(MovInstructionKind::RegToMem) {}
+// [0x66] [REX] opcode ModRM [SIB] [disp8/disp32], with |reg| in the reg
+// field of the ModRM byte.
+auto encode_reg_mem(u8 opcode, common::Reg reg, const common::MemRef &mem) -> common::InstructionBytes {
+	using enum common::BitWidth;
 
-	common::MemRef mem_ref;
-	common::Reg reg;
+	common::MemRefEncoding address = common::encode_mem_ref(common::index_of_reg_name(reg.name), mem);
+	bool is_segment = common::is_segment_register(reg.name);
+
+	auto rex = common::Rex()
+		.w(reg.width == b64 and not is_segment)
+		.r(common::requires_rex_extension(reg.name))
+		.x(address.rex_x)
+		.b(address.rex_b)
+		.present(common::requires_rex_prefix(reg.name));
+
+	common::InstructionBytes bytes;
+	common::emit_prefixes(bytes, reg.width == b16 and not is_segment, rex);
+	bytes.push_back(opcode);
+	bytes.append(address.bytes.span());
+	return bytes;
 }
 
-auto MovRegToReg::validate_semantics() -> void {
+} // namespace
+
+auto MovRegToReg::validate_semantics() const -> std::expected<void, std::string> {
 	using ::detail::one_of;
 	using common::is_segment_register;
 	using enum common::BitWidth;
-	using enum common::RegName;
 
 	// if the widths are different, we must moving to/from a segment register. 
 	// Otherwise this is an invalid mov instruction.
 	if (dst.width != src.width) {
-		fiska_assert(
-				is_segment_register(src.name) or is_segment_register(dst.name),
+		if (not is_segment_register(src.name) and not is_segment_register(dst.name)) {
+			return std::unexpected(fmt::format(
 				"Register size mismatch in mov instruction. src regsiter width = '{}' "
-				"and dst register width = '{}' bits", +src.width, +dst.width);
+				"and dst register width = '{}' bits", +src.width, +dst.width));
+		}
 		
 		if (is_segment_register(src.name)) {
-			fiska_assert(one_of(dst.width, b16, b32, b64),
-					"Destination register must be either r16/32/64. Dst width = '{}' bits",
-					+dst.width);
-
-		} else {
-			fiska_assert(one_of(src.width, b16, b64), 
-					"Source register must be r16/64 when moving data to a segment register. "
-					"Src width = '{}' bits", +src.width);
-					
+			if (not one_of(dst.width, b16, b32, b64)) {
+				return std::unexpected(fmt::format(
+					"Destination register must be either r16/32/64. Dst width = '{}' bits", +dst.width));
+			}
+
+		} else if (not one_of(src.width, b16, b64)) {
+			return std::unexpected(fmt::format(
+				"Source register must be r16/64 when moving data to a segment register. "
+				"Src width = '{}' bits", +src.width));
 		}
 
 	} else {
 		// |src| and |dst| registers have the same width.
 
-		u8 rex_prefix = common::Rex()
-			.r(common::requires_rex_extension(src.name))
-			.b(common::requires_rex_extension(dst.name))
-			.value();
+		if (is_segment_register(src.name) and is_segment_register(dst.name)) {
+			return std::unexpected(std::string("Can't move a segment register to another one"));
+		}
+
+		bool needs_rex = common::requires_rex_prefix(src.name) or common::requires_rex_prefix(dst.name);
 
 		// registers AH, BH, CH, DH can't be addressed when a REX prefix
 		// is present.
-		if (src.width == b8 and rex_prefix != 0) {
-			fiska_assert((not one_of(src.name, Ah, Bh, Ch, Dh)) 
-					and (not one_of(dst.name, Ah, Bh, Ch, Dh)),
-					"Registers AH, BH, CH, DH can't be addressed when a REX prefix is "
-					"present");
+		if (needs_rex and (common::forbids_rex_prefix(src.name) or common::forbids_rex_prefix(dst.name))) {
+			return std::unexpected(std::string(
+				"Registers AH, BH, CH, DH can't be addressed when a REX prefix is present"));
 		}
 	}
+	return {};
 }
 
-auto MovRegToReg::encode() -> std::vector<u8> {
-	// Make sure we have a valid mov instruction.
-	validate_semantics();
+auto MovRegToReg::encode() -> common::InstructionBytes {
+	// Make sure we have a valid mov instruction. The parser already rejected
+	// the invalid ones, so this only catches bugs.
+	auto valid = validate_semantics();
+	fiska_assert(valid.has_value(), "{}", valid.error());
 	// Op encoding.
 	//
 	// [MR] Operand1 (dst)    Operand2 (src)
 	//       ModRm:r/m (w)     ModRm:reg (r)
+	//
+	// [RM] is only used to move into a segment register (8E), which must be
+	// in ModRm:reg.
+	bool to_segment_register = common::is_segment_register(dst.name);
+	const common::Reg &reg = to_segment_register ? dst : src;
+	const common::Reg &rm = to_segment_register ? src : dst;
 
 	u8 modrm_byte = common::ModRm()
 		.mod(common::ModRm::register_addressing)
-		.rm(common::index_of_reg_name(dst.name))
-		.reg(common::index_of_reg_name(src.name))
+		.rm(common::index_of_reg_name(rm.name))
+		.reg(common::index_of_reg_name(reg.name))
 		.value();
 
-	u8 rex_prefix = common::Rex()
-		.w(std::max(+src.width, +dst.width) == 64)
-		.r(common::requires_rex_extension(src.name))
-		.b(common::requires_rex_extension(dst.name))
-		.value();
+	bool has_segment_register = common::is_segment_register(src.name) or to_segment_register;
+	// A move from a segment register to a 32 bit register already zero
+	// extends, so REX.W would only make it longer.
+	auto rex = common::Rex()
+		.w(not has_segment_register and src.width == common::BitWidth::b64)
+		.r(common::requires_rex_extension(reg.name))
+		.b(common::requires_rex_extension(rm.name))
+		.present(common::requires_rex_prefix(src.name) or common::requires_rex_prefix(dst.name));
+	// The operand size of a move from a segment register is the one of its
+	// destination. A move to a segment register is always 16 bits wide.
+	bool operand_size_override = dst.width == common::BitWidth::b16 and not common::is_segment_register(dst.name);
 
 	u8 opcode = [&] {
 		using enum common::BitWidth;
@@ -111,46 +145,180 @@ auto MovRegToReg::encode() -> std::vector<u8> {
 		fiska_unreachable();
 	}();
 
-	return {rex_prefix, opcode, modrm_byte};
+	// Only the prefixes that are needed. A REX of 0 would be decoded as an
+	// instruction of its own.
+	common::InstructionBytes bytes;
+	common::emit_prefixes(bytes, operand_size_override, rex);
+	bytes.push_back(opcode);
+	bytes.push_back(modrm_byte);
+	return bytes;
 }
 
-auto MovInstruction::encode() -> std::vector<u8> {
-	using enum MovInstructionKind;
+auto MovRegToMem::validate_semantics() const -> std::expected<void, std::string> {
+	return validate_reg_mem(src, dst);
+}
 
-	switch (kind) {
-		case RegToReg: 
-			return static_cast<MovRegToReg *>(this)->encode();
+auto MovRegToMem::encode() -> common::InstructionBytes {
+	auto valid = validate_semantics();
+	fiska_assert(valid.has_value(), "{}", valid.error());
+	// Op encoding.
+	//
+	// [MR] Operand1 (dst)    Operand2 (src)
+	//       ModRm:r/m (w)     ModRm:reg (r)
+	u8 opcode = [&] {
+		if (common::is_segment_register(src.name)) return u8(0x8c);
+		return src.width == common::BitWidth::b8 ? u8(0x88) : u8(0x89);
+	}();
+	return encode_reg_mem(opcode, src, dst);
+}
+
+auto MovMemToReg::validate_semantics() const -> std::expected<void, std::string> {
+	return validate_reg_mem(dst, src);
+}
 
-		default:
-			fiska_todo("Other MovInstruction kinds are not handled yet");
+auto MovMemToReg::encode() -> common::InstructionBytes {
+	auto valid = validate_semantics();
+	fiska_assert(valid.has_value(), "{}", valid.error());
+	// Op encoding.
+	//
+	// [RM] Operand1 (dst)    Operand2 (src)
+	//       ModRm:reg (w)     ModRm:r/m (r)
+	u8 opcode = [&] {
+		if (common::is_segment_register(dst.name)) return u8(0x8e);
+		return dst.width == common::BitWidth::b8 ? u8(0x8a) : u8(0x8b);
+	}();
+	return encode_reg_mem(opcode, dst, src);
+}
+
+auto MovImmToReg::validate_semantics() const -> std::expected<void, std::string> {
+	if (common::is_segment_register(dst.name)) {
+		return std::unexpected(std::string("Segment registers can't be loaded with an immediate"));
 	}
 
-	fiska_unreachable();
+	u32 width = +dst.width;
+	if (not common::fits_in_width(imm, width)) {
+		return std::unexpected(fmt::format("Immediate '{}' does not fit in {} bits", i64(imm), width));
+	}
+	return {};
 }
 
-auto MovInstructionParser::next_register(parser::Parser *parser) -> common::Reg {
-	auto reg_tok = parser->next_token();
-	auto reg_literal = parser->source_substring(
-			reg_tok.offset, reg_tok.offset + reg_tok.len);
+auto MovImmToReg::encode() -> common::InstructionBytes {
+	using enum common::BitWidth;
 
-	common::RegName reg_name = common::reg_name_of_str_pnc(reg_literal);
-	return {.name = reg_name, .width = common::bit_width_of_reg_name(reg_name)};
+	auto valid = validate_semantics();
+	fiska_assert(valid.has_value(), "{}", valid.error());
+
+	u8 index = common::index_of_reg_name(dst.name);
+	bool extended = common::requires_rex_extension(dst.name);
+	bool needs_rex = common::requires_rex_prefix(dst.name);
+	bool fits_in_u32 = imm <= std::numeric_limits<u32>::max();
+	bool fits_in_i32 = i64(imm) >= std::numeric_limits<i32>::min() and i64(imm) <= std::numeric_limits<i32>::max();
+
+	common::InstructionBytes bytes;
+	auto push_rex = [&](bool w) {
+		common::emit_prefixes(bytes, false, common::Rex().w(w).b(extended).present(needs_rex));
+	};
+
+	switch (dst.width) {
+		case b8:
+			push_rex(false);
+			bytes.push_back(u8(0xb0 + index));
+			bytes.append_le(imm, 1);
+			return bytes;
+
+		case b16:
+			common::emit_prefixes(bytes, true, common::Rex().b(extended));
+			bytes.push_back(u8(0xb8 + index));
+			bytes.append_le(imm, 2);
+			return bytes;
+
+		case b32:
+			push_rex(false);
+			bytes.push_back(u8(0xb8 + index));
+			bytes.append_le(imm, 4);
+			return bytes;
+
+		case b64:
+			// Writing the 32 bit register clears the upper half.
+			if (fits_in_u32) {
+				push_rex(false);
+				bytes.push_back(u8(0xb8 + index));
+				bytes.append_le(imm, 4);
+
+			} else if (fits_in_i32) {
+				push_rex(true);
+				bytes.push_back(0xc7);
+				bytes.push_back(common::ModRm().mod(common::ModRm::register_addressing).reg(0).rm(index).value());
+				bytes.append_le(imm, 4);
+
+			} else {
+				push_rex(true);
+				bytes.push_back(u8(0xb8 + index));
+				bytes.append_le(imm, 8);
+			}
+			return bytes;
+	}
+	fiska_unreachable();
 }
 
-auto MovInstructionParser::parse(parser::Parser *parser) -> MovInstruction * {
-	using common::Reg;
-	using enum lexer::TokenKind;
+auto encode_mov(parser::Form form, parser::OperandReader operands) -> common::InstructionBytes {
+	auto next_reg = [&]() -> common::Reg {
+		common::RegName name = operands.reg();
+		return {.name = name, .width = common::bit_width_of_reg_name(name)};
+	};
+
+	switch (form) {
+		case parser::Form::RegReg: {
+			common::Reg dst = next_reg();
+			common::Reg src = next_reg();
+			return MovRegToReg{.dst = dst, .src = src}.encode();
+		}
+
+		case parser::Form::RegMem: {
+			common::Reg dst = next_reg();
+			return MovMemToReg{.dst = dst, .src = operands.mem()}.encode();
+		}
 
-	parser->consume_pnc(LeftParen);
+		case parser::Form::MemReg: {
+			common::MemRef dst = operands.mem();
+			return MovRegToMem{.dst = dst, .src = next_reg()}.encode();
+		}
 
-	Reg dst_reg = next_register(parser);
-	parser->consume_pnc(Comma);
-	Reg src_reg = next_register(parser);
+		case parser::Form::RegImm: {
+			common::Reg dst = next_reg();
+			return MovImmToReg{.dst = dst, .imm = operands.imm()}.encode();
+		}
 
-	parser->consume_pnc(RightParen, SemiColon);
+		case parser::Form::NoOperands:
+			fiska_unreachable("mov takes two operands");
+	}
+	fiska_unreachable();
+}
 
+auto MovInstructionParser::parse(parser::Parser *parser, lexer::Token mnemonic_tok) -> Expected<void> {
+	parser::OperandList operands = fiska_try(parser->parse_operand_list());
+
+	std::optional<parser::Form> form = operands.form();
+	auto valid = [&] -> std::expected<void, std::string> {
+		switch (form.value_or(parser::Form::NoOperands)) {
+			case parser::Form::RegReg:
+				return MovRegToReg{.dst = operands[0].reg, .src = operands[1].reg}.validate_semantics();
+			case parser::Form::RegMem:
+				return MovMemToReg{.dst = operands[0].reg, .src = operands[1].mem}.validate_semantics();
+			case parser::Form::MemReg:
+				return MovRegToMem{.dst = operands[0].mem, .src = operands[1].reg}.validate_semantics();
+			case parser::Form::RegImm:
+				return MovImmToReg{.dst = operands[0].reg, .imm = operands[1].imm}.validate_semantics();
+			case parser::Form::NoOperands:
+				return std::unexpected(std::string(
+					"Unsupported operands for mov. Expected mov(reg, reg), mov(reg, mem), mov(mem, reg) or mov(reg, imm)"));
+		}
+		fiska_unreachable();
+	}();
+	if (not valid) return std::unexpected(parser->error(mnemonic_tok.offset, "{}", valid.error()));
 
-	return new MovRegToReg(dst_reg, src_reg);
+	parser->emit(common::X86Mnemonic::Mov, *form, mnemonic_tok.offset, operands);
+	return {};
 }
 
 
@@ -1,7 +1,8 @@
 #ifndef __FISKA_ASSEMBLER_FISKAS_X86_INSTRUCTIONS_MOV_PARSER_HH__
 #define __FISKA_ASSEMBLER_FISKAS_X86_INSTRUCTIONS_MOV_PARSER_HH__
 
-#include <vector>
+#include <expected>
+#include <string>
 
 #include "parser.hh"
 #include "base.hh"
@@ -9,32 +10,55 @@
 namespace fiskas {
 namespace x86_instruction {
 
-enum struct MovInstructionKind {
-	// Mov reg reg
-	RegToReg,
-	// Mov mem reg
-	RegToMem,
-	// Mov reg mem
-	MemToReg,
-	// Mov reg imm
-	ImmToReg,
-	// Mov reg moffs
-	MoffsToReg,
-	// Mov moffs reg
-	RegToMoffs
+// mov(dst, src) between two registers.
+struct MovRegToReg {
+	common::Reg dst;
+	common::Reg src;
+
+public:
+	// Why the mov can't be encoded, if it can't.
+	auto validate_semantics() const -> std::expected<void, std::string>;
+	auto encode() -> common::InstructionBytes;
+};
+
+// mov(mem, src), a store of a register.
+struct MovRegToMem {
+	common::MemRef dst;
+	common::Reg src;
+
+public:
+	auto validate_semantics() const -> std::expected<void, std::string>;
+	auto encode() -> common::InstructionBytes;
 };
 
-struct MovInstruction : parser::Instruction {
-	MovInstruction(MovInstructionKind kind_) 
-		: parser::Instruction(common::X86Mnemonic::Mov), kind(kind_) {}
+// mov(dst, mem), a load in a register.
+struct MovMemToReg {
+	common::Reg dst;
+	common::MemRef src;
 
-	MovInstructionKind kind;
-	auto encode() -> std::vector<u8>; 
+public:
+	auto validate_semantics() const -> std::expected<void, std::string>;
+	auto encode() -> common::InstructionBytes;
 };
 
+// mov(dst, imm). |imm| is in two's complement when it's negative.
+struct MovImmToReg {
+	common::Reg dst;
+	u64 imm;
+
+public:
+	auto validate_semantics() const -> std::expected<void, std::string>;
+	// A 64 bit register takes the shortest of B8+r imm32, which zero extends,
+	// REX.W C7 /0 imm32, which sign extends, and REX.W B8+r imm64.
+	auto encode() -> common::InstructionBytes;
+};
+
+// Encode a mov of form |form| whose operands are read from |operands|.
+auto encode_mov(parser::Form form, parser::OperandReader operands) -> common::InstructionBytes;
+
 struct MovInstructionParser {
-	static auto parse(parser::Parser *parser) -> MovInstruction *;
-	static auto next_register(parser::Parser *parser) -> common::Reg;
+	// Parse the operands of a mov and append it to the body being parsed.
+	static auto parse(parser::Parser *parser, lexer::Token mnemonic_tok) -> Expected<void>;
 };
 
 }
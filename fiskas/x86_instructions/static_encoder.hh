@@ -0,0 +1,257 @@
+#ifndef __FISKA_ASSEMBLER_FISKAS_X86_INSTRUCTIONS_STATIC_ENCODER_HH__
+#define __FISKA_ASSEMBLER_FISKAS_X86_INSTRUCTIONS_STATIC_ENCODER_HH__
+
+#include <concepts>
+
+#include "base.hh"
+#include "x86_common.hh"
+
+// ============================================================================
+// Encoders specialized at compile time
+//
+// For code that generates instructions from C++ and knows the form of each one
+// up front:
+//
+//     u8 *end = encode<X86Mnemonic::Mov>(out, regs::rax, regs::r9);
+//
+// The opcode, the prefixes that only depend on the operand types and the
+// layout of the operands are picked by overload resolution, which leaves a few
+// shifts and byte stores to do at runtime. Operand types that aren't a valid
+// form of the mnemonic don't compile.
+//
+// Unlike |MovImmToReg|, an immediate is encoded in the form of its type and
+// not in the shortest form of its value.
+//
+// |out| must have room for |common::max_instruction_size| bytes and the end of
+// the encoded instruction is returned.
+// ============================================================================
+namespace fiskas {
+namespace x86_instruction {
+
+// Register operands. |num| is the number of the register, 0 to 15, whose
+// bit 3 goes in the REX prefix.
+template <common::BitWidth bit_width>
+struct GprOperand {
+	constexpr static common::BitWidth width = bit_width;
+
+	u8 num{};
+
+public:
+	// Only for registers of |width| bits.
+	constexpr static auto of(common::RegName name) -> GprOperand {
+		fiska_assert(common::bit_width_of_reg_name(name) == width and not common::is_segment_register(name),
+				"'{}' is not a {} bits general purpose register", common::str_of_reg_name(name), +width);
+		return {u8(common::index_of_reg_name(name) | common::requires_rex_extension(name) << 3)};
+	}
+
+	constexpr auto low_bits() const -> u8 { return num & 0b111; }
+	constexpr auto extended() const -> bool { return num >> 3; }
+};
+
+using Reg64 = GprOperand<common::BitWidth::b64>;
+using Reg32 = GprOperand<common::BitWidth::b32>;
+using Reg16 = GprOperand<common::BitWidth::b16>;
+
+// 8 bit registers also need to tell AH, CH, DH and BH apart from SPL, BPL,
+// SIL and DIL, which share their numbers.
+struct Reg8 {
+	constexpr static common::BitWidth width = common::BitWidth::b8;
+
+	u8 num{};
+	// AH, CH, DH or BH. Can't be used with a REX prefix.
+	bool high_byte{};
+
+public:
+	constexpr static auto of(common::RegName name) -> Reg8 {
+		fiska_assert(common::bit_width_of_reg_name(name) == width,
+				"'{}' is not an 8 bits register", common::str_of_reg_name(name));
+		return {
+			.num = u8(common::index_of_reg_name(name) | common::requires_rex_extension(name) << 3),
+			.high_byte = common::forbids_rex_prefix(name),
+		};
+	}
+
+	constexpr auto low_bits() const -> u8 { return num & 0b111; }
+	constexpr auto extended() const -> bool { return num >> 3; }
+	// SPL, BPL, SIL and DIL are only reachable with a REX prefix.
+	constexpr auto needs_rex() const -> bool { return num >= 4 and not high_byte; }
+};
+
+template <typename T>
+concept GprOperandType = std::same_as<T, Reg64> or std::same_as<T, Reg32>
+	or std::same_as<T, Reg16> or std::same_as<T, Reg8>;
+
+// Immediates, truncated to their width. |Imm32| is sign extended when moved to
+// a 64 bit register.
+template <usz num_bytes>
+struct ImmOperand {
+	u64 value{};
+};
+
+using Imm8 = ImmOperand<1>;
+using Imm16 = ImmOperand<2>;
+using Imm32 = ImmOperand<4>;
+using Imm64 = ImmOperand<8>;
+
+// Immediate as wide as register |R|.
+template <typename R>
+using ImmOfWidth = ImmOperand<+R::width / 8>;
+
+// A memory operand. Its addressing bytes still depend on the registers and the
+// displacement, so they are computed at runtime by |common::encode_mem_ref|.
+struct Mem {
+	common::MemRef ref;
+};
+
+namespace regs {
+
+constexpr Reg64 rax{0}, rcx{1}, rdx{2}, rbx{3}, rsp{4}, rbp{5}, rsi{6}, rdi{7};
+constexpr Reg64 r8{8}, r9{9}, r10{10}, r11{11}, r12{12}, r13{13}, r14{14}, r15{15};
+
+constexpr Reg32 eax{0}, ecx{1}, edx{2}, ebx{3}, esp{4}, ebp{5}, esi{6}, edi{7};
+constexpr Reg32 r8d{8}, r9d{9}, r10d{10}, r11d{11}, r12d{12}, r13d{13}, r14d{14}, r15d{15};
+
+constexpr Reg16 ax{0}, cx{1}, dx{2}, bx{3}, sp{4}, bp{5}, si{6}, di{7};
+constexpr Reg16 r8w{8}, r9w{9}, r10w{10}, r11w{11}, r12w{12}, r13w{13}, r14w{14}, r15w{15};
+
+constexpr Reg8 al{0}, cl{1}, dl{2}, bl{3}, spl{4}, bpl{5}, sil{6}, dil{7};
+constexpr Reg8 ah{4, true}, ch{5, true}, dh{6, true}, bh{7, true};
+constexpr Reg8 r8b{8}, r9b{9}, r10b{10}, r11b{11}, r12b{12}, r13b{13}, r14b{14}, r15b{15};
+
+} // namespace regs
+
+namespace static_detail {
+
+using common::BitWidth;
+
+// Prefixes whose presence only depends on |width|. The REX prefix is emitted
+// when |rex_bits| isn't 0 or when |force_rex|.
+template <BitWidth width>
+constexpr auto emit_prefixes(u8 *out, u8 rex_bits, bool force_rex) -> u8 * {
+	if constexpr (width == BitWidth::b16) *out++ = common::operand_size_prefix;
+	if constexpr (width == BitWidth::b64) {
+		*out++ = common::Rex::fixed_field | common::Rex::w_bit | rex_bits;
+	} else {
+		if (rex_bits or force_rex) *out++ = common::Rex::fixed_field | rex_bits;
+	}
+	return out;
+}
+
+template <typename R>
+constexpr auto needs_rex(R reg) -> bool {
+	if constexpr (std::same_as<R, Reg8>) return reg.needs_rex();
+	else return false;
+}
+
+template <typename R>
+constexpr auto check_high_byte(R reg, bool rex_present) -> void {
+	if constexpr (std::same_as<R, Reg8>) {
+		fiska_assert(not (reg.high_byte and rex_present),
+				"Registers AH, BH, CH, DH can't be addressed when a REX prefix is present");
+	}
+}
+
+template <usz num_bytes>
+constexpr auto emit_imm(u8 *out, u64 value) -> u8 * {
+	for (usz i = 0; i < num_bytes; ++i) *out++ = u8(value >> (8 * i));
+	return out;
+}
+
+// [0x66] [REX] opcode ModRM [SIB] [disp8/disp32], with |reg| in the reg
+// field of the ModRM byte.
+template <typename R>
+auto emit_reg_mem(u8 *out, u8 opcode, R reg, const common::MemRef &mem) -> u8 * {
+	common::MemRefEncoding address = common::encode_mem_ref(reg.low_bits(), mem);
+	u8 rex_bits = u8(reg.extended() * common::Rex::r_bit
+		| address.rex_x * common::Rex::x_bit
+		| address.rex_b * common::Rex::b_bit);
+	check_high_byte(reg, rex_bits or R::width == BitWidth::b64);
+
+	out = emit_prefixes<R::width>(out, rex_bits, needs_rex(reg));
+	*out++ = opcode;
+	for (u8 byte : address.bytes) *out++ = byte;
+	return out;
+}
+
+} // namespace static_detail
+
+// Encoding of |mnemonic| on operands of types |Operands|. Only the
+// specializations below exist.
+template <common::X86Mnemonic mnemonic, typename... Operands>
+struct StaticEncoder;
+
+// ret
+template <>
+struct StaticEncoder<common::X86Mnemonic::Ret> {
+	constexpr static auto encode(u8 *out) -> u8 * {
+		*out++ = 0xc3;
+		return out;
+	}
+};
+
+// mov(reg, reg), both of the same width. [MR] 88 /r or 89 /r.
+template <GprOperandType R>
+struct StaticEncoder<common::X86Mnemonic::Mov, R, R> {
+	constexpr static auto encode(u8 *out, R dst, R src) -> u8 * {
+		u8 rex_bits = u8(src.extended() * common::Rex::r_bit | dst.extended() * common::Rex::b_bit);
+		bool force_rex = static_detail::needs_rex(dst) or static_detail::needs_rex(src);
+		static_detail::check_high_byte(dst, rex_bits or force_rex);
+		static_detail::check_high_byte(src, rex_bits or force_rex);
+
+		out = static_detail::emit_prefixes<R::width>(out, rex_bits, force_rex);
+		*out++ = R::width == common::BitWidth::b8 ? 0x88 : 0x89;
+		*out++ = u8(common::ModRm::register_addressing << 6 | src.low_bits() << 3 | dst.low_bits());
+		return out;
+	}
+};
+
+// mov(reg, imm) with an immediate of the width of the register. B0+r ib, B8+r iw,
+// B8+r id and REX.W B8+r io.
+template <GprOperandType R>
+struct StaticEncoder<common::X86Mnemonic::Mov, R, ImmOfWidth<R>> {
+	constexpr static auto encode(u8 *out, R dst, ImmOfWidth<R> imm) -> u8 * {
+		static_detail::check_high_byte(dst, dst.extended());
+
+		out = static_detail::emit_prefixes<R::width>(out, dst.extended() * common::Rex::b_bit, static_detail::needs_rex(dst));
+		*out++ = u8((R::width == common::BitWidth::b8 ? 0xb0 : 0xb8) + dst.low_bits());
+		return static_detail::emit_imm<+R::width / 8>(out, imm.value);
+	}
+};
+
+// mov(reg64, imm32), sign extended. REX.W C7 /0 id.
+template <>
+struct StaticEncoder<common::X86Mnemonic::Mov, Reg64, Imm32> {
+	constexpr static auto encode(u8 *out, Reg64 dst, Imm32 imm) -> u8 * {
+		out = static_detail::emit_prefixes<Reg64::width>(out, dst.extended() * common::Rex::b_bit, false);
+		*out++ = 0xc7;
+		*out++ = u8(common::ModRm::register_addressing << 6 | dst.low_bits());
+		return static_detail::emit_imm<4>(out, imm.value);
+	}
+};
+
+// mov(reg, mem), a load. [RM] 8A /r or 8B /r.
+template <GprOperandType R>
+struct StaticEncoder<common::X86Mnemonic::Mov, R, Mem> {
+	static auto encode(u8 *out, R dst, const Mem &src) -> u8 * {
+		return static_detail::emit_reg_mem(out, R::width == common::BitWidth::b8 ? 0x8a : 0x8b, dst, src.ref);
+	}
+};
+
+// mov(mem, reg), a store. [MR] 88 /r or 89 /r.
+template <GprOperandType R>
+struct StaticEncoder<common::X86Mnemonic::Mov, Mem, R> {
+	static auto encode(u8 *out, const Mem &dst, R src) -> u8 * {
+		return static_detail::emit_reg_mem(out, R::width == common::BitWidth::b8 ? 0x88 : 0x89, src, dst.ref);
+	}
+};
+
+template <common::X86Mnemonic mnemonic, typename... Operands>
+	requires requires { &StaticEncoder<mnemonic, Operands...>::encode; }
+constexpr auto encode(u8 *out, Operands... operands) -> u8 * {
+	return StaticEncoder<mnemonic, Operands...>::encode(out, operands...);
+}
+
+} // namespace x86_instruction
+} // namespace fiskas
+
+#endif // __FISKA_ASSEMBLER_FISKAS_X86_INSTRUCTIONS_STATIC_ENCODER_HH__
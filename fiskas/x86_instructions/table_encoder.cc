@@ -0,0 +1,307 @@
+#include <limits>
+
+#include "base.hh"
+#include "x86_instructions/table_encoder.hh"
+
+namespace fiskas {
+namespace x86_instruction {
+
+namespace {
+
+// Values of the modrm column of the spec.
+namespace modrm_field {
+constexpr u8 R = Encoding::modrm_r;
+constexpr u8 None = Encoding::no_modrm;
+constexpr u8 D0 = 0, D1 = 1, D2 = 2, D3 = 3, D4 = 4, D5 = 5, D6 = 6, D7 = 7;
+} // namespace modrm_field
+
+constexpr Encoding encodings[] = {
+#define FISKA_ENCODING(mnemonic_, form_, size_, opcode_, modrm_, imm_) \
+	{                                                                  \
+		.mnemonic = common::X86Mnemonic::mnemonic_,                    \
+		.form = parser::Form::form_,                                   \
+		.size = Encoding::Size::size_,                                 \
+		.opcode = u8(opcode_),                                         \
+		.modrm = modrm_field::modrm_,                                  \
+		.imm = Encoding::Imm::imm_,                                    \
+	},
+#include "x86_instructions/instructions.def"
+};
+
+struct EncodingRange {
+	u16 first;
+	u16 count;
+};
+
+// Where the encodings of each mnemonic and form start in |encodings|.
+constexpr auto encoding_ranges = [] {
+	std::array<std::array<EncodingRange, parser::num_forms>, common::num_x86_mnemonics> ranges{};
+	for (usz i = 0; i < std::size(encodings); ++i) {
+		EncodingRange &range = ranges[usz(encodings[i].mnemonic)][usz(encodings[i].form)];
+		if (range.count == 0) range.first = u16(i);
+		else if (usz(range.first) + range.count != i) throw "The encodings of a mnemonic and form must be next to each other";
+		range.count++;
+	}
+	return ranges;
+}();
+
+auto str_of_form_operands(parser::Form form) -> std::string_view {
+	switch (form) {
+		case parser::Form::NoOperands: return "";
+		case parser::Form::RegReg: return "reg, reg";
+		case parser::Form::RegMem: return "reg, mem";
+		case parser::Form::MemReg: return "mem, reg";
+		case parser::Form::RegImm: return "reg, imm";
+	}
+	fiska_unreachable();
+}
+
+// e.g "Unsupported operands for lea. Expected lea(reg, mem)".
+auto unsupported_operands(common::X86Mnemonic mnemonic) -> std::string {
+	std::string name = common::str_of_x86_mnemonic(mnemonic);
+	std::vector<std::string> expected;
+	for (usz form = 0; form < parser::num_forms; ++form) {
+		if (encoding_ranges[usz(mnemonic)][form].count == 0) continue;
+		expected.push_back(fmt::format("{}({})", name, str_of_form_operands(parser::Form(form))));
+	}
+
+	std::string message = fmt::format("Unsupported operands for {}. Expected ", name);
+	for (usz i = 0; i < expected.size(); ++i) {
+		if (i > 0) message += i + 1 == expected.size() ? " or " : ", ";
+		message += expected[i];
+	}
+	return message;
+}
+
+// |value| truncated to |width| bits, then sign extended.
+auto sign_extended(u64 value, u32 width) -> i64 {
+	if (width == 64) return i64(value);
+	return i64(value << (64 - width)) >> (64 - width);
+}
+
+} // namespace
+
+auto encodings_of(common::X86Mnemonic mnemonic, parser::Form form) -> std::span<const Encoding> {
+	EncodingRange range = encoding_ranges[usz(mnemonic)][usz(form)];
+	return {encodings + range.first, range.count};
+}
+
+auto TableInstruction::of_operands(common::X86Mnemonic mnemonic, const parser::OperandList &operands) -> TableInstruction {
+	TableInstruction instruction{
+		.mnemonic = mnemonic,
+		.form = operands.form().value_or(parser::Form::NoOperands),
+	};
+
+	usz num_regs = 0;
+	for (usz i = 0; i < operands.size; ++i) {
+		switch (operands[i].kind) {
+			case parser::OperandKind::Reg: instruction.regs[num_regs++] = operands[i].reg; break;
+			case parser::OperandKind::Mem: instruction.mem = operands[i].mem; break;
+			case parser::OperandKind::Imm: instruction.imm = operands[i].imm; break;
+		}
+	}
+	return instruction;
+}
+
+auto TableInstruction::read(common::X86Mnemonic mnemonic, parser::Form form, parser::OperandReader operands)
+	-> TableInstruction
+{
+	auto next_reg = [&]() -> common::Reg {
+		common::RegName name = operands.reg();
+		return {.name = name, .width = common::bit_width_of_reg_name(name)};
+	};
+
+	TableInstruction instruction{.mnemonic = mnemonic, .form = form};
+	switch (form) {
+		case parser::Form::NoOperands:
+			break;
+
+		case parser::Form::RegReg:
+			instruction.regs[0] = next_reg();
+			instruction.regs[1] = next_reg();
+			break;
+
+		case parser::Form::RegMem:
+			instruction.regs[0] = next_reg();
+			instruction.mem = operands.mem();
+			break;
+
+		case parser::Form::MemReg:
+			instruction.mem = operands.mem();
+			instruction.regs[0] = next_reg();
+			break;
+
+		case parser::Form::RegImm:
+			instruction.regs[0] = next_reg();
+			instruction.imm = operands.imm();
+			break;
+	}
+	return instruction;
+}
+
+auto TableInstruction::uses_segment_register() const -> bool {
+	switch (form) {
+		case parser::Form::NoOperands: return false;
+		case parser::Form::RegReg: return common::is_segment_register(regs[0].name) or common::is_segment_register(regs[1].name);
+		case parser::Form::RegMem:
+		case parser::Form::MemReg:
+		case parser::Form::RegImm: return common::is_segment_register(regs[0].name);
+	}
+	fiska_unreachable();
+}
+
+auto TableInstruction::select_encoding() const -> std::expected<const Encoding *, std::string> {
+	using enum parser::Form;
+
+	std::span<const Encoding> candidates = encodings_of(mnemonic, form);
+	if (candidates.empty()) return std::unexpected(unsupported_operands(mnemonic));
+	if (form == NoOperands) return &candidates.front();
+
+	// Only needed for the errors.
+	auto name = [&] { return common::str_of_x86_mnemonic(mnemonic); };
+	std::span<const common::Reg> used_regs(regs.data(), form == RegReg ? 2 : 1);
+	for (const common::Reg &reg : used_regs) {
+		if (common::is_segment_register(reg.name)) {
+			return std::unexpected(fmt::format("Segment register '{}' can't be an operand of {}",
+					common::str_of_reg_name(reg.name), name()));
+		}
+	}
+	if (form == RegReg and regs[0].width != regs[1].width) {
+		return std::unexpected(fmt::format(
+			"Register size mismatch in {} instruction. src register width = '{}' "
+			"and dst register width = '{}' bits", name(), +regs[1].width, +regs[0].width));
+	}
+
+	// Registers AH, BH, CH, DH can't be addressed when a REX prefix is present.
+	u32 width = +regs[0].width;
+	bool has_mem = form == RegMem or form == MemReg;
+	bool needs_rex = width == 64
+		or (has_mem and mem.base and common::requires_rex_extension(*mem.base))
+		or (has_mem and mem.index and common::requires_rex_extension(*mem.index));
+	bool forbids_rex = false;
+	for (const common::Reg &reg : used_regs) {
+		needs_rex |= common::requires_rex_prefix(reg.name);
+		forbids_rex |= common::forbids_rex_prefix(reg.name);
+	}
+	if (needs_rex and forbids_rex) {
+		return std::unexpected(std::string("Registers AH, BH, CH, DH can't be addressed when a REX prefix is present"));
+	}
+
+	// 64 bit operands take a sign extended 32 bit immediate at most.
+	if (form == RegImm) {
+		if (not common::fits_in_width(imm, width)) {
+			return std::unexpected(fmt::format("Immediate '{}' does not fit in {} bits", i64(imm), width));
+		}
+		if (width == 64 and (i64(imm) < std::numeric_limits<i32>::min() or i64(imm) > std::numeric_limits<i32>::max())) {
+			return std::unexpected(fmt::format("Immediate '{}' does not fit in a sign extended 32 bit immediate", i64(imm)));
+		}
+	}
+
+	bool is_accumulator = common::index_of_reg_name(regs[0].name) == 0 and not common::requires_rex_extension(regs[0].name);
+	for (const Encoding &encoding : candidates) {
+		if ((encoding.size == Encoding::Size::B8) != (width == 8)) continue;
+		if (form == RegImm and encoding.modrm == Encoding::no_modrm and not is_accumulator) continue;
+		if (encoding.imm == Encoding::Imm::Ib) {
+			i64 value = sign_extended(imm, width);
+			if (value < std::numeric_limits<i8>::min() or value > std::numeric_limits<i8>::max()) continue;
+		}
+		return &encoding;
+	}
+	return std::unexpected(fmt::format("{} doesn't take {} bit operands", name(), width));
+}
+
+auto TableInstruction::encode() const -> common::InstructionBytes {
+	using enum common::BitWidth;
+
+	auto selected = select_encoding();
+	fiska_assert(selected.has_value(), "{}", selected.error());
+	const Encoding &encoding = **selected;
+
+	common::InstructionBytes bytes;
+	if (form == parser::Form::NoOperands) {
+		bytes.push_back(encoding.opcode);
+		return bytes;
+	}
+
+	common::Reg reg = regs[0];
+	auto rex = common::Rex()
+		.w(reg.width == b64)
+		.present(common::requires_rex_prefix(reg.name));
+
+	switch (form) {
+		// [MR] Operand1 (dst)    Operand2 (src)
+		//       ModRm:r/m (w)     ModRm:reg (r)
+		case parser::Form::RegReg: {
+			common::Reg src = regs[1];
+			rex.r(common::requires_rex_extension(src.name))
+				.b(common::requires_rex_extension(reg.name))
+				.present(common::requires_rex_prefix(src.name));
+
+			common::emit_prefixes(bytes, reg.width == b16, rex);
+			bytes.push_back(encoding.opcode);
+			bytes.push_back(common::ModRm()
+				.mod(common::ModRm::register_addressing)
+				.reg(common::index_of_reg_name(src.name))
+				.rm(common::index_of_reg_name(reg.name))
+				.value());
+			return bytes;
+		}
+
+		// The register is in ModRm:reg and the memory operand in ModRm:r/m,
+		// whichever comes first.
+		case parser::Form::RegMem:
+		case parser::Form::MemReg: {
+			common::MemRefEncoding address = common::encode_mem_ref(common::index_of_reg_name(reg.name), mem);
+			rex.r(common::requires_rex_extension(reg.name)).x(address.rex_x).b(address.rex_b);
+
+			common::emit_prefixes(bytes, reg.width == b16, rex);
+			bytes.push_back(encoding.opcode);
+			bytes.append(address.bytes.span());
+			return bytes;
+		}
+
+		// [MI] Operand1 (dst)    Operand2 (src)
+		//       ModRm:r/m (w)     imm8/16/32
+		//
+		// [I] without ModRM only takes the accumulator.
+		case parser::Form::RegImm: {
+			rex.b(common::requires_rex_extension(reg.name));
+
+			common::emit_prefixes(bytes, reg.width == b16, rex);
+			bytes.push_back(encoding.opcode);
+			if (encoding.modrm != Encoding::no_modrm) {
+				bytes.push_back(common::ModRm()
+					.mod(common::ModRm::register_addressing)
+					.reg(encoding.modrm)
+					.rm(common::index_of_reg_name(reg.name))
+					.value());
+			}
+			bytes.append_le(imm, encoding.imm == Encoding::Imm::Ib ? 1 : std::min<usz>(+reg.width / 8, 4));
+			return bytes;
+		}
+
+		case parser::Form::NoOperands:
+			fiska_unreachable();
+	}
+	fiska_unreachable();
+}
+
+auto TableInstructionParser::parse(parser::Parser *parser, common::X86Mnemonic mnemonic, lexer::Token mnemonic_tok)
+	-> Expected<void>
+{
+	parser::OperandList operands = fiska_try(parser->parse_operand_list());
+
+	std::optional<parser::Form> form = operands.form();
+	if (not form) {
+		return std::unexpected(parser->error(mnemonic_tok.offset, "{}", unsupported_operands(mnemonic)));
+	}
+
+	auto selected = TableInstruction::of_operands(mnemonic, operands).select_encoding();
+	if (not selected) return std::unexpected(parser->error(mnemonic_tok.offset, "{}", selected.error()));
+
+	parser->emit(mnemonic, *form, mnemonic_tok.offset, operands);
+	return {};
+}
+
+} // namespace x86_instruction
+} // namespace fiskas
@@ -0,0 +1,74 @@
+#ifndef __FISKA_ASSEMBLER_FISKAS_X86_INSTRUCTIONS_TABLE_ENCODER_HH__
+#define __FISKA_ASSEMBLER_FISKAS_X86_INSTRUCTIONS_TABLE_ENCODER_HH__
+
+#include <expected>
+#include <span>
+#include <string>
+
+#include "base.hh"
+#include "parser.hh"
+
+namespace fiskas {
+namespace x86_instruction {
+
+// One row of |x86_instructions/instructions.def|.
+struct Encoding {
+	enum struct Size : u8 {
+		Unsized,
+		B8,
+		Wide,
+	};
+
+	enum struct Imm : u8 {
+		None,
+		Ib,
+		Iz,
+	};
+
+	// ModRM.reg holds a register operand.
+	constexpr static u8 modrm_r = 0xff;
+	// No ModRM byte.
+	constexpr static u8 no_modrm = 0xfe;
+
+	common::X86Mnemonic mnemonic;
+	parser::Form form;
+	Size size;
+	u8 opcode;
+	// |modrm_r|, |no_modrm| or the /digit.
+	u8 modrm;
+	Imm imm;
+};
+
+// The encodings of |mnemonic| on operands of |form|, shortest first. Empty if
+// there are none.
+auto encodings_of(common::X86Mnemonic mnemonic, parser::Form form) -> std::span<const Encoding>;
+
+// An instruction encoded from the table. The operands are the ones of its
+// form, in order: |regs| holds its registers and |mem| and |imm| its memory
+// operand and immediate if it has one.
+struct TableInstruction {
+	common::X86Mnemonic mnemonic;
+	parser::Form form;
+	std::array<common::Reg, 2> regs{};
+	common::MemRef mem{};
+	u64 imm{};
+
+public:
+	static auto of_operands(common::X86Mnemonic mnemonic, const parser::OperandList &operands) -> TableInstruction;
+	static auto read(common::X86Mnemonic mnemonic, parser::Form form, parser::OperandReader operands) -> TableInstruction;
+
+	auto uses_segment_register() const -> bool;
+	// The first encoding that takes the operands, or why there is none.
+	auto select_encoding() const -> std::expected<const Encoding *, std::string>;
+	auto encode() const -> common::InstructionBytes;
+};
+
+struct TableInstructionParser {
+	// Parse the operands of |mnemonic| and append it to the body being parsed.
+	static auto parse(parser::Parser *parser, common::X86Mnemonic mnemonic, lexer::Token mnemonic_tok) -> Expected<void>;
+};
+
+} // namespace x86_instruction
+} // namespace fiskas
+
+#endif // __FISKA_ASSEMBLER_FISKAS_X86_INSTRUCTIONS_TABLE_ENCODER_HH__
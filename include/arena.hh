@@ -0,0 +1,124 @@
+#ifndef __FISKA_ASSEMBLER_ARENA_HH__
+#define __FISKA_ASSEMBLER_ARENA_HH__
+
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <span>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "base.hh"
+
+// Bump allocator for objects that all die together. Allocating is a pointer
+// bump in the current block, and everything is freed at once when the arena
+// goes away. Objects that need their destructor to run have it called then, in
+// reverse order of creation.
+//
+// Pointers handed out stay valid when the arena is moved.
+struct Arena {
+	constexpr static usz default_block_size = usz(64) << 10;
+
+	struct Destructor {
+		void (*destroy)(void *object);
+		void *object;
+	};
+
+	std::vector<std::unique_ptr<std::byte[]>> blocks;
+	std::byte *curr{};
+	std::byte *end{};
+	std::vector<Destructor> destructors;
+	usz block_size = default_block_size;
+	// Bytes handed out so far, not counting alignment padding.
+	usz bytes_used{};
+
+public:
+	explicit Arena(usz block_size_ = default_block_size) : block_size(block_size_) {}
+
+	Arena(const Arena &) = delete;
+	auto operator=(const Arena &) -> Arena & = delete;
+
+	Arena(Arena &&other) noexcept { swap(other); }
+	auto operator=(Arena &&other) noexcept -> Arena & {
+		Arena dead = std::move(*this);
+		swap(other);
+		return *this;
+	}
+
+	~Arena() {
+		for (auto it = destructors.rbegin(); it != destructors.rend(); ++it) it->destroy(it->object);
+	}
+
+	auto allocate(usz size, usz align) -> void * {
+		fiska_assert(std::has_single_bit(align), "Alignment '{}' is not a power of 2", align);
+		bytes_used += size;
+
+		if (void *ptr = bump(size, align)) return ptr;
+
+		// Big allocations get a block of their own so that the rest of the
+		// current block isn't thrown away.
+		if (size + align > block_size / 4) {
+			std::byte *block = new_block(size + align);
+			return block + (align - uptr(block) % align) % align;
+		}
+
+		std::byte *block = new_block(block_size);
+		curr = block;
+		end = block + block_size;
+		return bump(size, align);
+	}
+
+	template <typename T, typename... Args>
+	auto make(Args&&... args) -> T * {
+		T *object = new (allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+		if constexpr (not std::is_trivially_destructible_v<T>) {
+			destructors.push_back({
+				.destroy = [](void *ptr) { static_cast<T *>(ptr)->~T(); },
+				.object = object,
+			});
+		}
+		return object;
+	}
+
+	// Copy of |values| living in the arena.
+	template <typename T>
+		requires std::is_trivially_copyable_v<T>
+	auto copy(std::span<const T> values) -> std::span<T> {
+		if (values.empty()) return {};
+		T *data = static_cast<T *>(allocate(values.size_bytes(), alignof(T)));
+		std::memcpy(data, values.data(), values.size_bytes());
+		return {data, values.size()};
+	}
+
+	auto copy(std::string_view str) -> std::string_view {
+		auto chars = copy(std::span<const char>(str.data(), str.size()));
+		return {chars.data(), chars.size()};
+	}
+
+private:
+	auto bump(usz size, usz align) -> void * {
+		usz padding = (align - uptr(curr) % align) % align;
+		if (usz(end - curr) < padding + size) return nullptr;
+
+		std::byte *ptr = curr + padding;
+		curr = ptr + size;
+		return ptr;
+	}
+
+	auto new_block(usz size) -> std::byte * {
+		return blocks.emplace_back(std::make_unique_for_overwrite<std::byte[]>(size)).get();
+	}
+
+	auto swap(Arena &other) noexcept -> void {
+		std::swap(blocks, other.blocks);
+		std::swap(curr, other.curr);
+		std::swap(end, other.end);
+		std::swap(destructors, other.destructors);
+		std::swap(block_size, other.block_size);
+		std::swap(bytes_used, other.bytes_used);
+	}
+};
+
+#endif // __FISKA_ASSEMBLER_ARENA_HH__
@@ -1,21 +1,29 @@
 #ifndef __FISKA_ASSEMBLER_BASE_HH__
 #define __FISKA_ASSEMBLER_BASE_HH__
 
+#include <algorithm>
+#include <array>
+#include <bit>
 #include <cassert>
 #include <chrono>
 #include <cstddef>
 #include <cstdint>
 #include <cstdlib>
+#include <cstring>
 #include <fcntl.h>
 #include <filesystem>
 #include <fmt/format.h>
+#include <optional>
 #include <ranges>
+#include <string>
 #include <string_view>
 #include <sys/mman.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <utility>
+#include <unistd.h>
 #include <unordered_map>
+#include <vector>
 
 using i8 = int8_t;
 using i16 = int16_t;
@@ -95,6 +103,121 @@ struct StringHash {
 template <typename Value>
 using StringMap = std::unordered_map<std::string, Value, StringHash, std::equal_to<>>; 
 
+// ============================================================================
+// Immutable string map built at compile time.
+//
+// The table is a perfect hash built with the "hash and displace" scheme: keys
+// are first split into buckets, and every bucket gets a displacement that sends
+// all its keys to free slots of the table. A lookup is therefore one hash of the
+// key, one mix with the bucket displacement and a single key comparison.
+//
+// Use |make_static_string_map| to build one.
+// ============================================================================
+template <typename Value, usz N>
+struct StaticStringMap {
+	using Entry = std::pair<std::string_view, Value>;
+
+	constexpr static usz num_buckets = N;
+	constexpr static usz capacity = std::bit_ceil(N + N / 4 + 1);
+
+	std::array<Entry, capacity> table{};
+	std::array<u32, num_buckets> displacements{};
+
+public:
+	consteval explicit StaticStringMap(const Entry (&entries)[N]) {
+		std::array<usz, N> bucket_of_entry{};
+		std::array<usz, num_buckets> bucket_size{};
+		for (usz i = 0; i < N; ++i) {
+			if (entries[i].first.empty()) throw "Empty keys are not supported";
+			for (usz j = 0; j < i; ++j) {
+				if (entries[i].first == entries[j].first) throw "Duplicate key";
+			}
+			bucket_of_entry[i] = bucket(hash(entries[i].first));
+			bucket_size[bucket_of_entry[i]]++;
+		}
+
+		// Place the most crowded buckets first while the table is still empty.
+		std::array<usz, num_buckets> order{};
+		for (usz b = 0; b < num_buckets; ++b) order[b] = b;
+		std::ranges::sort(order, [&](usz a, usz b) { return bucket_size[a] > bucket_size[b]; });
+
+		std::array<bool, capacity> used{};
+		for (usz b : order) {
+			if (bucket_size[b] == 0) break;
+
+			for (u32 d = 0;; ++d) {
+				if (d == 1u << 20) throw "Failed to find a perfect hash for the keys";
+
+				std::array<usz, capacity> taken{};
+				usz num_taken = 0;
+				bool ok = true;
+				for (usz i = 0; i < N and ok; ++i) {
+					if (bucket_of_entry[i] != b) continue;
+
+					usz s = slot(hash(entries[i].first), d);
+					ok = not used[s];
+					for (usz t = 0; t < num_taken and ok; ++t) ok = taken[t] != s;
+					taken[num_taken++] = s;
+				}
+				if (not ok) continue;
+
+				displacements[b] = d;
+				for (usz i = 0; i < N; ++i) {
+					if (bucket_of_entry[i] != b) continue;
+
+					usz s = slot(hash(entries[i].first), d);
+					used[s] = true;
+					table[s] = entries[i];
+				}
+				break;
+			}
+		}
+	}
+
+	constexpr auto get(std::string_view key) const -> std::optional<Value> {
+		u64 h = hash(key);
+		const Entry &entry = table[slot(h, displacements[bucket(h)])];
+		if (key.empty() or entry.first != key) return std::nullopt;
+		return entry.second;
+	}
+
+	constexpr auto contains(std::string_view key) const -> bool { return get(key).has_value(); }
+
+	constexpr static auto size() -> usz { return N; }
+
+	// Entries in table order.
+	constexpr auto items() const {
+		return table | vws::filter([](const Entry &e) { return not e.first.empty(); });
+	}
+
+private:
+	// FNV-1a.
+	constexpr static auto hash(std::string_view key) -> u64 {
+		u64 h = 0xcbf29ce484222325;
+		for (char c : key) {
+			h ^= u8(c);
+			h *= 0x100000001b3;
+		}
+		return h;
+	}
+
+	constexpr static auto bucket(u64 h) -> usz { return usz(h % num_buckets); }
+
+	// Murmur3 finalizer.
+	constexpr static auto slot(u64 h, u32 displacement) -> usz {
+		h ^= u64(displacement) * 0x9e3779b97f4a7c15;
+		h ^= h >> 33;
+		h *= 0xff51afd7ed558ccd;
+		h ^= h >> 33;
+		return usz(h & (capacity - 1));
+	}
+};
+
+template <typename Value, usz N>
+consteval auto make_static_string_map(const std::pair<std::string_view, Value> (&entries)[N]) {
+	return StaticStringMap<Value, N>(entries);
+}
+
 // ============================================================================
 // Symbol concatenation
 // ============================================================================
@@ -189,6 +312,36 @@ struct Timer {
 // ============================================================================
 // File utilities
 // ============================================================================
+
+// Read-only mapping of a file. The pages stay mapped for as long as this object
+// is alive, so any view handed out by |view()| must not outlive it.
+struct MappedFile {
+    void *ptr = nullptr;
+    usz size{};
+
+public:
+    MappedFile() = default;
+    MappedFile(void *ptr_, usz size_) : ptr(ptr_), size(size_) {}
+
+    MappedFile(const MappedFile &) = delete;
+    auto operator=(const MappedFile &) -> MappedFile & = delete;
+
+    MappedFile(MappedFile &&other) noexcept
+        : ptr(std::exchange(other.ptr, nullptr)), size(std::exchange(other.size, 0)) {}
+
+    auto operator=(MappedFile &&other) noexcept -> MappedFile & {
+        std::swap(ptr, other.ptr);
+        std::swap(size, other.size);
+        return *this;
+    }
+
+    ~MappedFile() {
+        if (ptr) munmap(ptr, size);
+    }
+
+    auto view() const -> std::string_view { return {static_cast<const char *>(ptr), size}; }
+};
+
 struct File {
     static auto write(void *data, u64 size, const fs::path &path) -> void {
         auto file = std::fopen(path.c_str(), "wb");
@@ -228,6 +381,29 @@ struct File {
 
         return content;
     }
+
+    // Map the file to RAM without copying it.
+    static auto map(const fs::path &path) -> MappedFile {
+        int fd = open(path.c_str(), O_RDONLY);
+		fiska_assert(fd >= 0, 
+				"Failed to open file: '{}'", path.string());
+
+        struct stat file_stat {};
+		fiska_assert(fstat(fd, &file_stat) >= 0,
+				"Failed to get filestat when opening file: '{}'", path.string());
+
+        // mmap refuses zero sized mappings.
+        if (file_stat.st_size == 0) {
+            close(fd);
+            return {};
+        }
+
+        void *ptr = mmap(nullptr, usz(file_stat.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+		fiska_assert(ptr != MAP_FAILED, "Failed to map file: '{}' to memory", path.string());
+
+        close(fd);
+        return {ptr, usz(file_stat.st_size)};
+    }
 };
 
 #endif // __FISKA_UNICODE_PARSING_BASE_HH__
@@ -172,8 +172,9 @@ public:
 	}
 
 	constexpr static auto num_sections() -> u64 {
-		SectionTable sectable;
-		return sectable.sections.size();
+		// One section per |SectionType|. Building a |SectionTable| here is not
+		// a constant expression since its constructor allocates.
+		return u64(+SectionType::Data) + 1;
 	}
 };
 
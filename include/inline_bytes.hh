@@ -0,0 +1,55 @@
+#ifndef __FISKA_ASSEMBLER_INLINE_BYTES_HH__
+#define __FISKA_ASSEMBLER_INLINE_BYTES_HH__
+
+#include <algorithm>
+#include <array>
+#include <initializer_list>
+#include <span>
+
+#include "base.hh"
+
+// Up to |capacity| bytes stored inline. Encoders return their output in one of
+// these so that encoding an instruction never allocates.
+template <usz capacity>
+struct InlineBytes {
+	static_assert(capacity <= 255, "The length is stored in a single byte");
+
+	std::array<u8, capacity> bytes{};
+	u8 len{};
+
+public:
+	constexpr InlineBytes() = default;
+	constexpr InlineBytes(std::initializer_list<u8> init) {
+		for (u8 byte : init) push_back(byte);
+	}
+
+	constexpr auto push_back(u8 byte) -> void {
+		fiska_assert(len < capacity, "More than '{}' bytes in an InlineBytes", capacity);
+		bytes[len++] = byte;
+	}
+
+	constexpr auto append(std::span<const u8> other) -> void {
+		fiska_assert(len + other.size() <= capacity, "More than '{}' bytes in an InlineBytes", capacity);
+		std::ranges::copy(other, bytes.begin() + len);
+		len = u8(len + other.size());
+	}
+
+	// Little endian bytes of the |num_bytes| low bytes of |value|.
+	constexpr auto append_le(u64 value, usz num_bytes) -> void {
+		for (usz i = 0; i < num_bytes; ++i) push_back(u8(value >> (8 * i)));
+	}
+
+	constexpr auto size() const -> usz { return len; }
+	constexpr auto empty() const -> bool { return len == 0; }
+	constexpr auto data() const -> const u8 * { return bytes.data(); }
+	constexpr auto begin() const -> const u8 * { return bytes.data(); }
+	constexpr auto end() const -> const u8 * { return bytes.data() + len; }
+	constexpr auto span() const -> std::span<const u8> { return {bytes.data(), len}; }
+	constexpr auto operator[](usz idx) const -> u8 { return bytes[idx]; }
+
+	constexpr auto operator==(const InlineBytes &other) const -> bool {
+		return std::ranges::equal(span(), other.span());
+	}
+};
+
+#endif // __FISKA_ASSEMBLER_INLINE_BYTES_HH__
@@ -0,0 +1,96 @@
+#ifndef __FISKA_ASSEMBLER_THREAD_POOL_HH__
+#define __FISKA_ASSEMBLER_THREAD_POOL_HH__
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "base.hh"
+
+// Fixed set of worker threads running batches of independent jobs.
+// The thread calling |parallel_for| works on the batch too.
+struct ThreadPool {
+	std::vector<std::jthread> workers;
+
+	std::mutex mutex;
+	std::condition_variable work_available;
+	std::condition_variable work_done;
+
+	// State of the batch being run. Guarded by |mutex|, except for |next_job|.
+	const std::function<void(usz)> *job = nullptr;
+	usz job_count{};
+	std::atomic<usz> next_job{};
+	usz busy_workers{};
+	u64 generation{};
+	bool stopping = false;
+
+public:
+	// |num_threads| counts the calling thread, so a pool of 1 runs everything inline.
+	explicit ThreadPool(usz num_threads = std::thread::hardware_concurrency()) {
+		for (usz i = 1; i < num_threads; ++i) {
+			workers.emplace_back([this] { worker_loop(); });
+		}
+	}
+
+	ThreadPool(const ThreadPool &) = delete;
+	auto operator=(const ThreadPool &) -> ThreadPool & = delete;
+
+	~ThreadPool() {
+		{
+			std::scoped_lock lock(mutex);
+			stopping = true;
+		}
+		work_available.notify_all();
+		// Join before the mutex and condition variables go away.
+		workers.clear();
+	}
+
+	auto num_threads() const -> usz { return workers.size() + 1; }
+
+	// Run |fn(i)| for every i in [0, count) and wait until all of them are done.
+	auto parallel_for(usz count, const std::function<void(usz)> &fn) -> void {
+		{
+			std::scoped_lock lock(mutex);
+			job = &fn;
+			job_count = count;
+			next_job = 0;
+			busy_workers = workers.size();
+			generation++;
+		}
+		work_available.notify_all();
+
+		run_jobs(fn, count);
+
+		std::unique_lock lock(mutex);
+		work_done.wait(lock, [this] { return busy_workers == 0; });
+		job = nullptr;
+	}
+
+private:
+	auto run_jobs(const std::function<void(usz)> &fn, usz count) -> void {
+		for (usz i = next_job++; i < count; i = next_job++) fn(i);
+	}
+
+	auto worker_loop() -> void {
+		u64 seen_generation = 0;
+		std::unique_lock lock(mutex);
+		while (true) {
+			work_available.wait(lock, [&] { return stopping or generation != seen_generation; });
+			if (stopping) return;
+			seen_generation = generation;
+
+			const auto *fn = job;
+			usz count = job_count;
+			lock.unlock();
+			run_jobs(*fn, count);
+			lock.lock();
+
+			if (--busy_workers == 0) work_done.notify_all();
+		}
+	}
+};
+
+#endif // __FISKA_ASSEMBLER_THREAD_POOL_HH__
@@ -11,8 +11,11 @@ using ByteVec = std::vector<u8>;
 
 auto Code::create_dummy_code() -> Code {
 	Code c;
-	c.text = {0x48, 0xc7, 0xc0, 0x8b, 0x01, 0x00, 0x00, 0xc3,
-		      0x48, 0xc7, 0xc0, 0x8d, 0x01, 0x00, 0x00, 0xc3};
+	// mov(rax, 395); ret(); and mov(rax, 397); ret();
+	// The immediates fit in 32 bits, so the zero extending B8+r form is used
+	// instead of REX.W C7 /0, which takes 2 more bytes.
+	c.text = {0xb8, 0x8b, 0x01, 0x00, 0x00, 0xc3,
+		      0xb8, 0x8d, 0x01, 0x00, 0x00, 0xc3};
 	c.data = {0xff, 0xff, 0xff, 0x7f};
 
 	c.symbols.push_back({
@@ -21,7 +24,7 @@ auto Code::create_dummy_code() -> Code {
 			.name = "test_function_1"s,
 	});
 	c.symbols.push_back({
-			.offset = 8,
+			.offset = 6,
 			.code_section = SectionType::Text,
 			.name = "test_function_2"s,
 	});